@@ -0,0 +1,428 @@
+/*
+  AVR cycle benchmark: runs the Leonardo firmware image under simavr and
+  counts the cycles of the functions that set the sample rate headroom.
+
+    avrbench firmware.elf [ms per phase]
+
+  Build the image with pio run -e bench (BENCH reads command bytes from
+  GPIOR1, see loop()), or use pio run -e bench -t avrbench which builds
+  this runner and the firmware and runs both.
+
+  Peripherals: an INA219 on TWI (500mA at 5V with 1A bursts for 40ms
+  every 250ms), and a sink on SPI that counts display bytes. USB is not
+  enumerated, the CDC line state is set so Serial is true and the firmware
+  builds its reports, the USB sends themselves fail at once.
+
+  Phases: boot (reset to the first loop()), each screen with S:n, the
+  message screen (Z:) and a command mix. For every phase and watched
+  function one JSON line on stdout:
+    {"phase":"S:1","fn":"drawScope","calls":n,"min":c,"avg":c,"max":c}
+  cycles exclude interrupts that fired during the call, except for
+  interrupt handlers and the functions they call (readADCs includes the
+  TWI interrupts it waits for). Then a phase summary and the headroom:
+    {"phase":"S:1","cycles":c,"isr":c,"isr_pct":p,"spi":bytes,"spi_data":bytes}
+    {"headroom":{"sample_cycles":c,"readADCs_max":c,"isr_pct_max":p,"max_hz":f}}
+  compare.py diffs two of these files.
+
+  Status: unverified. This runner has not been built against simavr or
+  run on a pio run -e bench image yet, so nothing it prints has been
+  checked against a real run. What is most likely to be wrong:
+  - inaHook() answers the TWI states (address ACK, register pointer,
+    repeated start into the READ phase) from the datasheet, not from
+    trying it against the simavr TWI model
+  - lineStateAddr takes lineState at offset 7 of _usbLineInfo (the
+    LineInfo of the Arduino CDC.cpp), a different core breaks it
+  - A call ends when SP rises above its entry SP. A function entered
+    with a jump (tail call) is timed together with its caller, and one
+    that never returns is never counted. loop() returns every pass now
+    but would not if it ever blocked
+  The image is the default build: S:7 and the O?, Y:, T:, X? and K? of
+  the command mix need the FEATURE_ flags (see main.cpp), without them
+  S:7 wraps to S:1 and those commands only reply an error.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <elf.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "sim_irq.h"
+#include "sim_cycle_timers.h"
+#include "avr_twi.h"
+#include "avr_spi.h"
+
+#define F_CPU           16000000UL
+#define SAMPLE_US       1000            // READFREQ in main.cpp
+#define DATA_OFFSET     0x800000        // avr-gcc data address space in the ELF
+
+// ATmega32u4 data space addresses
+#define ADDR_PORTC      0x28
+#define ADDR_GPIOR1     0x4A
+#define ADDR_PLLCSR     0x49
+#define PLLCSR_PLOCK    0x01
+#define DC_BIT          0x40            // PC6, Arduino pin 5, OLED D/C
+
+#define INA219_ADDRESS  (0x40 << 1)
+
+#define MAX_WATCH       64
+#define MAX_DEPTH       32
+
+// Functions to time, C++ names are matched on their mangled prefix
+static const char *watchNames[] = {
+  "readADCs", "processInput", "readInput", "serialOutput", "sendEvent",
+  "drawScope", "drawEnergy", "drawPeakMins", "drawInrush", "drawBig", "drawMsg",
+  "drawBottomLine", "drawGraph", "u8g_NextPage", "loop", "setup",
+};
+
+typedef struct {
+  char name[48];
+  uint32_t addr;
+  int isr;
+  uint32_t calls;
+  uint64_t sum, min, max;
+} watch_t;
+
+typedef struct {
+  int w;
+  uint16_t sp;
+  uint64_t start;
+  uint64_t isrStart;
+} frame_t;
+
+static avr_t *avr;
+static watch_t watch[MAX_WATCH];
+static int watches;
+static uint8_t *watchAt;                // Flash word -> watch index + 1
+static uint32_t flashWords;
+static frame_t stack[MAX_DEPTH];
+static int depth, isrDepth;
+static uint64_t isrCycles;
+static uint32_t lineStateAddr;          // _usbLineInfo.lineState in data space, 0 if not found
+static int lineStateSet;
+static uint32_t spiBytes, spiData;
+
+static const char *input;               // Command bytes still to send through GPIOR1
+
+/* ---- ELF symbols ---- */
+
+typedef struct {
+  char *data;
+  Elf32_Sym *syms;
+  uint32_t count;
+  const char *names;
+} symtab_t;
+
+static int loadSymbols(const char *path, symtab_t *t)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f) return 0;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  t->data = malloc(size);
+  if (fread(t->data, 1, size, f) != (size_t)size) { fclose(f); return 0; }
+  fclose(f);
+  Elf32_Ehdr *eh = (Elf32_Ehdr *)t->data;
+  Elf32_Shdr *sh = (Elf32_Shdr *)(t->data + eh->e_shoff);
+  for (int i = 0; i < eh->e_shnum; i++) {
+    if (sh[i].sh_type != SHT_SYMTAB) continue;
+    t->syms = (Elf32_Sym *)(t->data + sh[i].sh_offset);
+    t->count = sh[i].sh_size / sizeof(Elf32_Sym);
+    t->names = t->data + sh[sh[i].sh_link].sh_offset;
+    return 1;
+  }
+  return 0;
+}
+
+// Symbol called name, or a C++ function/object name (_Z<len><name>...)
+static Elf32_Sym *findSymbol(symtab_t *t, const char *name, int type)
+{
+  char mangled[64], local[64];
+  snprintf(mangled, sizeof(mangled), "_Z%zu%s", strlen(name), name);
+  snprintf(local, sizeof(local), "_ZL%zu%s", strlen(name), name);
+  for (uint32_t i = 0; i < t->count; i++) {
+    Elf32_Sym *s = &t->syms[i];
+    if (ELF32_ST_TYPE(s->st_info) != type) continue;
+    const char *n = t->names + s->st_name;
+    if (!strcmp(n, name)) return s;
+    if (!strncmp(n, mangled, strlen(mangled)) || !strncmp(n, local, strlen(local))) return s;
+  }
+  return NULL;
+}
+
+static void addWatch(const char *name, uint32_t addr, int isr)
+{
+  if (watches >= MAX_WATCH || addr / 2 >= flashWords) return;
+  watch_t *w = &watch[watches];
+  snprintf(w->name, sizeof(w->name), "%s", name);
+  w->addr = addr;
+  w->isr = isr;
+  watchAt[addr / 2] = ++watches;
+}
+
+static void setupWatches(symtab_t *t)
+{
+  for (size_t i = 0; i < sizeof(watchNames) / sizeof(watchNames[0]); i++) {
+    Elf32_Sym *s = findSymbol(t, watchNames[i], STT_FUNC);
+    if (s) addWatch(watchNames[i], s->st_value, 0);
+    else printf("{\"fn\":\"%s\",\"err\":\"no symbol\"}\n", watchNames[i]);
+  }
+  // Every interrupt handler counts as interrupt time
+  for (uint32_t i = 0; i < t->count; i++) {
+    Elf32_Sym *s = &t->syms[i];
+    const char *n = t->names + s->st_name;
+    if (ELF32_ST_TYPE(s->st_info) == STT_FUNC && !strncmp(n, "__vector_", 9) && strcmp(n, "__vector_default"))
+      addWatch(n, s->st_value, 1);
+  }
+  Elf32_Sym *s = findSymbol(t, "_usbLineInfo", STT_OBJECT);
+  // LineInfo: u32 dwDTERate, u8 bCharFormat, bParityType, bDataBits, lineState
+  if (s) lineStateAddr = s->st_value - DATA_OFFSET + 7;
+}
+
+/* ---- Timing ---- */
+
+static uint16_t sp(void)
+{
+  return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+static void resetStats(void)
+{
+  for (int i = 0; i < watches; i++) {
+    watch[i].calls = 0;
+    watch[i].sum = watch[i].max = 0;
+    watch[i].min = UINT64_MAX;
+  }
+  spiBytes = spiData = 0;
+}
+
+// Called before every instruction: pops returned calls, pushes entered ones
+static void track(void)
+{
+  uint16_t s = sp();
+  while (depth && s > stack[depth - 1].sp) {
+    frame_t *f = &stack[--depth];
+    watch_t *w = &watch[f->w];
+    uint64_t cycles = avr->cycle - f->start;
+    if (w->isr) {
+      if (--isrDepth == 0) isrCycles += cycles;
+    } else if (!isrDepth) {
+      cycles -= isrCycles - f->isrStart;
+    }
+    w->calls++;
+    w->sum += cycles;
+    if (cycles < w->min) w->min = cycles;
+    if (cycles > w->max) w->max = cycles;
+  }
+  uint32_t word = avr->pc / 2;
+  if (word >= flashWords || !watchAt[word]) return;
+  int w = watchAt[word] - 1;
+  if (depth && stack[depth - 1].w == w && stack[depth - 1].sp == s) return;  //Still on the first instruction
+  if (depth == MAX_DEPTH) return;
+  frame_t *f = &stack[depth++];
+  f->w = w;
+  f->sp = s;
+  f->start = avr->cycle;
+  f->isrStart = isrCycles;
+  if (watch[w].isr) isrDepth++;
+  if (!lineStateSet && lineStateAddr && !strcmp(watch[w].name, "loop")) {
+    // .bss is cleared by now, tell CDC a terminal is open
+    avr->data[lineStateAddr] = 3;
+    lineStateSet = 1;
+  }
+}
+
+// Runs until the virtual time reaches until, feeding input through GPIOR1
+static int runUntil(uint64_t until)
+{
+  while (avr->cycle < until) {
+    if (input && *input && !avr->data[ADDR_GPIOR1]) avr->data[ADDR_GPIOR1] = *input++;
+    track();
+    int state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed) return 0;
+  }
+  return 1;
+}
+
+static void report(const char *phase, uint64_t cycles, uint64_t isr)
+{
+  for (int i = 0; i < watches; i++) {
+    watch_t *w = &watch[i];
+    if (!w->calls) continue;
+    printf("{\"phase\":\"%s\",\"fn\":\"%s\",\"calls\":%u,\"min\":%llu,\"avg\":%llu,\"max\":%llu}\n",
+      phase, w->name, w->calls, (unsigned long long)w->min,
+      (unsigned long long)(w->sum / w->calls), (unsigned long long)w->max);
+  }
+  printf("{\"phase\":\"%s\",\"cycles\":%llu,\"isr\":%llu,\"isr_pct\":%.2f,\"spi\":%u,\"spi_data\":%u}\n",
+    phase, (unsigned long long)cycles, (unsigned long long)isr, cycles ? 100.0 * isr / cycles : 0.0,
+    spiBytes, spiData);
+}
+
+/* ---- Peripherals ---- */
+
+static uint8_t inaPtr;
+static uint16_t inaConfig = 0x399F, inaCal;
+static int inaByte, inaSelected;
+static avr_irq_t *inaIrq;
+
+static uint16_t inaRegister(uint8_t reg)
+{
+  uint64_t ms = avr->cycle / (F_CPU / 1000);
+  int32_t mA = 500 + ((ms % 250) < 40 ? 1000 : 0);
+  int32_t shunt = mA * 10;                         // 10uV LSB on 0.1R
+  int32_t current = shunt * inaCal / 4096;
+  switch (reg) {
+    case 0: return inaConfig;
+    case 1: return shunt;
+    case 2: return ((5000 / 4) << 3) | 0x2;        // 5V, conversion ready
+    case 3: return current * 1250 / 5000;
+    case 4: return current;
+    case 5: return inaCal;
+  }
+  return 0;
+}
+
+static void inaHook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  avr_twi_msg_irq_t v;
+  v.u.v = value;
+  if (v.u.twi.msg & TWI_COND_STOP) inaSelected = 0;
+  if (v.u.twi.msg & TWI_COND_START) {
+    inaSelected = (v.u.twi.addr & ~1) == INA219_ADDRESS;
+    inaByte = 0;
+    if (inaSelected) avr_raise_irq(inaIrq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, v.u.twi.addr, 1));
+  }
+  if (!inaSelected) return;
+  if (v.u.twi.msg & TWI_COND_WRITE) {
+    static uint8_t msb;
+    avr_raise_irq(inaIrq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, v.u.twi.addr, 1));
+    if (inaByte == 0) inaPtr = v.u.twi.data;
+    else if (inaByte == 1) msb = v.u.twi.data;
+    else if (inaByte == 2) {
+      uint16_t val = (msb << 8) | v.u.twi.data;
+      if (inaPtr == 0) inaConfig = val & 0x7FFF;
+      if (inaPtr == 5) inaCal = val & 0xFFFE;
+    }
+    inaByte++;
+  }
+  if (v.u.twi.msg & TWI_COND_READ) {
+    uint16_t val = inaRegister(inaPtr);
+    uint8_t data = (inaByte++ & 1) ? val & 0xFF : val >> 8;
+    avr_raise_irq(inaIrq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_READ, v.u.twi.addr, data));
+  }
+}
+
+static void spiHook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  spiBytes++;
+  if (avr->data[ADDR_PORTC] & DC_BIT) spiData++;
+}
+
+// USB clock setup waits for the PLL to lock
+static uint8_t pllRead(struct avr_t *avr, avr_io_addr_t addr, void *param)
+{
+  return avr->data[addr] | PLLCSR_PLOCK;
+}
+
+static void setupPeripherals(void)
+{
+  static const char *names[] = {"ina219.in", "ina219.out"};
+  inaIrq = avr_alloc_irq(&avr->irq_pool, 0, 2, names);
+  avr_irq_register_notify(inaIrq + TWI_IRQ_OUTPUT, inaHook, NULL);
+  avr_connect_irq(inaIrq + TWI_IRQ_INPUT, avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT));
+  avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT), inaIrq + TWI_IRQ_OUTPUT);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT), spiHook, NULL);
+  avr_register_io_read(avr, ADDR_PLLCSR, pllRead, NULL);
+}
+
+/* ---- Phases ---- */
+
+typedef struct {
+  const char *name;
+  const char *input;
+} phase_t;
+
+static const phase_t phases[] = {
+  {"S:1", "S:1\n"},
+  {"S:2", "S:2\n"},
+  {"S:3", "S:3\n"},
+  {"S:4", "S:4\n"},
+  {"S:5", "S:5\n"},
+  {"S:6", "S:6\n"},
+  {"S:7", "S:7\n"},
+  {"msg", "S:1;Z:\n"},
+  {"cmd", "V?;R?;W?;F?;S?;O?;Y:12345;T:;X?;K?;R:100;F:1023,100,0,0,1;F:255,1000,0,0,1\n"},
+};
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s firmware.elf [ms per phase]\n", argv[0]);
+    return 2;
+  }
+  uint32_t ms = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000;
+
+  elf_firmware_t fw;
+  memset(&fw, 0, sizeof(fw));
+  if (elf_read_firmware(argv[1], &fw) != 0) {
+    fprintf(stderr, "can't read %s\n", argv[1]);
+    return 1;
+  }
+  if (!fw.mmcu[0]) strcpy(fw.mmcu, "atmega32u4");
+  if (!fw.frequency) fw.frequency = F_CPU;
+  avr = avr_make_mcu_by_name(fw.mmcu);
+  if (!avr) {
+    fprintf(stderr, "no simavr core for %s\n", fw.mmcu);
+    return 1;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &fw);
+
+  symtab_t syms;
+  memset(&syms, 0, sizeof(syms));
+  if (!loadSymbols(argv[1], &syms)) {
+    fprintf(stderr, "no symbol table in %s\n", argv[1]);
+    return 1;
+  }
+  flashWords = (avr->flashend + 1) / 2;
+  watchAt = calloc(flashWords, 1);
+  setupWatches(&syms);
+  setupPeripherals();
+  resetStats();
+
+  // Boot: reset to the first loop()
+  int loopWatch = -1;
+  for (int i = 0; i < watches; i++) if (!strcmp(watch[i].name, "loop")) loopWatch = i;
+  while (loopWatch >= 0 && !watch[loopWatch].calls && !(depth && stack[depth - 1].w == loopWatch)) {
+    if (!runUntil(avr->cycle + 1)) break;
+  }
+  report("boot", avr->cycle, isrCycles);
+
+  uint64_t isrMax = 0, readMax = 0, readSum = 0, readCalls = 0;
+  for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); p++) {
+    resetStats();
+    uint64_t start = avr->cycle, isrStart = isrCycles;
+    input = phases[p].input;
+    if (!runUntil(start + (uint64_t)ms * (F_CPU / 1000))) {
+      fprintf(stderr, "firmware stopped in phase %s\n", phases[p].name);
+      return 1;
+    }
+    uint64_t cycles = avr->cycle - start, isr = isrCycles - isrStart;
+    report(phases[p].name, cycles, isr);
+    if (isr * 10000 / cycles > isrMax) isrMax = isr * 10000 / cycles;
+    for (int i = 0; i < watches; i++) {
+      if (strcmp(watch[i].name, "readADCs") || !watch[i].calls) continue;
+      if (watch[i].max > readMax) readMax = watch[i].max;
+      readSum += watch[i].sum;
+      readCalls += watch[i].calls;
+    }
+  }
+  printf("{\"headroom\":{\"sample_cycles\":%lu,\"readADCs_max\":%llu,\"readADCs_avg\":%llu,\"isr_pct_max\":%.2f,\"max_hz\":%.0f}}\n",
+    F_CPU / 1000000 * SAMPLE_US, (unsigned long long)readMax,
+    (unsigned long long)(readCalls ? readSum / readCalls : 0), isrMax / 100.0,
+    readMax ? (double)F_CPU / readMax : 0.0);
+  return 0;
+}
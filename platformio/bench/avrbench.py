@@ -0,0 +1,15 @@
+# pio run -e bench -t avrbench: builds the firmware and bench/avrbench, runs
+# the image under simavr and keeps the JSON report in the build directory
+Import("env")
+
+env.AddCustomTarget(
+    name="avrbench",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[
+        "make -C $PROJECT_DIR/bench",
+        "$PROJECT_DIR/bench/avrbench $BUILD_DIR/${PROGNAME}.elf > $BUILD_DIR/avrbench.json",
+        "cat $BUILD_DIR/avrbench.json",
+    ],
+    title="AVR cycle benchmark",
+    description="Cycles of the sampling ISR, screens, reports and commands under simavr",
+)
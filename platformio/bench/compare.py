@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Compares two avrbench reports: compare.py old.json new.json
+
+Prints avg and max cycles per phase and function that changed, and the
+phase totals, with the difference in percent.
+"""
+import json
+import sys
+
+
+def load(path):
+    funcs, phases, headroom = {}, {}, {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue
+            r = json.loads(line)
+            if "headroom" in r:
+                headroom = r["headroom"]
+            elif "fn" in r and "calls" in r:
+                funcs[(r["phase"], r["fn"])] = r
+            elif "cycles" in r:
+                phases[r["phase"]] = r
+    return funcs, phases, headroom
+
+
+def pct(old, new):
+    return "%+.1f%%" % (100.0 * (new - old) / old) if old else "new"
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    old_f, old_p, old_h = load(sys.argv[1])
+    new_f, new_p, new_h = load(sys.argv[2])
+    for key in sorted(set(old_f) | set(new_f)):
+        o, n = old_f.get(key), new_f.get(key)
+        if not o or not n:
+            print("%-6s %-16s %s" % (key[0], key[1], "only new" if n else "only old"))
+        elif o["avg"] != n["avg"] or o["max"] != n["max"]:
+            print("%-6s %-16s avg %8d -> %8d %7s  max %8d -> %8d %7s" % (
+                key[0], key[1], o["avg"], n["avg"], pct(o["avg"], n["avg"]),
+                o["max"], n["max"], pct(o["max"], n["max"])))
+    for phase in sorted(set(old_p) & set(new_p)):
+        o, n = old_p[phase], new_p[phase]
+        print("%-6s isr %5.2f%% -> %5.2f%%" % (phase, o["isr_pct"], n["isr_pct"]))
+    for key in sorted(set(old_h) & set(new_h)):
+        print("headroom %-13s %10s -> %10s" % (key, old_h[key], new_h[key]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,6 @@
+# pio run -e fuzz: libFuzzer comes with clang, which also has to link the
+# harness so the fuzzer and sanitizer runtimes get pulled in
+Import("env")
+
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+env.Append(LINKFLAGS=["-fsanitize=fuzzer,address,undefined"])
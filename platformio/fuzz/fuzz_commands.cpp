@@ -0,0 +1,113 @@
+/*
+  libFuzzer harness for the serial command parser, built by pio run -e fuzz
+  (needs clang) and run from the project directory:
+    .pio/build/fuzz/program fuzz/corpus -dict=fuzz/commands.dict
+
+  Each input goes in over the host Serial and loop() runs on the virtual
+  clock until it has all been read, INPUT_PER_LOOP bytes at a time like on
+  the device. A newline then ends whatever command was left open. After
+  every input the parser state and every setting a command can change are
+  checked against their limits, AddressSanitizer and UBSan catch out of
+  bounds accesses and overflowing arithmetic on the way.
+
+  Firmware globals carry over between inputs, so each input starts by
+  sending FUZZ_DEFAULTS and a crash reproduces from its input alone.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "Wire.h"
+#include "INA219Model.h"
+#include "USBTester.h"
+
+// Settings as after a reset without saved config, except stats every 100ms with every field
+// subscribed so the longest report runs after each input
+#define FUZZ_DEFAULTS "\nA:0;O:0;D:1;K:0;E:0;W:400;P:100;R:100;F:1023,100,0,0,1;N:0,4000,20;S:1\n"
+// Loops run after the input so reports, dumps and events get to use what it set, at least
+// one stats period unless the input made it longer than FUZZ_SETTLE_MAX_MS
+#define FUZZ_SETTLE_MS 5
+#define FUZZ_SETTLE_MAX_MS 1000
+
+#define CHECK(c) do { if (!(c)) { fprintf(stderr, "invariant failed: %s\n", #c); abort(); } } while (0)
+
+// Firmware globals the checks need
+extern uint8_t input_Buffer_Index;
+extern uint8_t current_screen;
+extern uint8_t oldScreen;
+extern bool msgDisplay;
+extern int16_t ledWarn;
+extern eventT eventType;
+extern outputT outputFormat;
+extern uint16_t serialOutputRate;
+extern uint8_t rawRate;
+extern uint8_t dump_Buf;
+extern uint16_t dump_Offset;
+extern uint16_t dump_End;
+extern volatile uint16_t capture_Count;
+extern uint16_t inrush_Window;
+extern uint16_t inrush_Total;
+extern uint8_t inrush_Stride;
+uint16_t dumpSize(int32_t buf);
+
+static INA219Model ina;
+
+// Runs loop() until the host side input has been read
+static void feed(const uint8_t *data, size_t size)
+{
+  Serial.inject(data, size);
+  while (Serial.available()) {
+    loop();
+    native_advance(1000);
+  }
+}
+
+static void check()
+{
+  // Parser
+  CHECK(input_Buffer_Index < INPUT_BUFFER_SIZE);
+  // Screens, the message screen only while a message is up
+  CHECK(current_screen < MAX_SCREENS || current_screen == MSGSCREEN);
+  CHECK(msgDisplay == (current_screen == MSGSCREEN));
+  CHECK(oldScreen < MAX_SCREENS);
+  // Thresholds and rates
+  CHECK(ledWarn >= 0 && ledWarn <= 3000);
+  CHECK(eventType >= DISABLED && eventType <= PERCENT);
+  CHECK(outputFormat == OUT_JSON || outputFormat == OUT_BINARY);
+  CHECK(outputFormat != OUT_JSON || !serialOutputRate || serialOutputRate >= 100);
+  CHECK(rawRate >= 1);
+  // Dumps stay inside their buffer
+  CHECK(dump_Offset <= dump_End);
+  CHECK(dump_Offset == dump_End || dump_End <= dumpSize(dump_Buf));
+  // Inrush bins fit the capture buffer
+  CHECK(inrush_Window >= 1 && inrush_Window <= 1000);
+  CHECK(inrush_Stride >= 1 && (uint32_t)inrush_Stride * CAPTURE_MEMORY >= inrush_Total);
+  CHECK(capture_Count <= CAPTURE_MEMORY);
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  native_reset();
+  ina.set(5000, 500);
+  ina.burst(0, 100000, 10000, 1000);
+  Wire.attach(INA219_MODEL_ADDRESS, &ina);
+  setup();
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  feed((const uint8_t *)FUZZ_DEFAULTS, sizeof(FUZZ_DEFAULTS) - 1);
+  check();
+  feed(data, size);
+  check();
+  feed((const uint8_t *)"\n", 1);
+  uint16_t settle = FUZZ_SETTLE_MS;
+  if (serialOutputRate >= settle && serialOutputRate < FUZZ_SETTLE_MAX_MS) settle = serialOutputRate + 1;
+  for (uint16_t i = 0; i < settle; i++) {
+    loop();
+    native_advance(1000);
+  }
+  check();
+  Serial.output.clear();
+  return 0;
+}
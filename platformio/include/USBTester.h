@@ -0,0 +1,38 @@
+/**
+ * Sizes, limits and enums of the firmware that the host code checks against,
+ * fuzz/ includes this instead of keeping copies that drift from main.cpp
+*/
+#ifndef USBTESTER_H
+#define USBTESTER_H
+
+#include <Arduino.h>
+
+// Serial input buffer, one command at a time, commands end with ';' or newline
+#define               INPUT_BUFFER_SIZE 32
+
+// Capture buffer, mA samples, K: and the inrush capture fill it
+#define               CAPTURE_MEMORY 256
+
+// Multiple screen support, S:n selects screen n-1
+#ifdef FEATURE_INRUSH
+const byte            MAX_SCREENS = 7;
+const byte            INRUSHSCREEN = 6;
+#else
+const byte            MAX_SCREENS = 6;
+#endif
+const byte            MSGSCREEN = 7; //Message screen, only while a message shows
+
+//Set event type we are triggering on or false if no events
+enum eventT {
+  DISABLED = 0,
+  WARN = 1, //based on set mA threshhold
+  PERCENT = 2 //based on percent changed
+};
+
+//Output format, JSON for the Java app or binary frames (see Frame.h)
+enum outputT {
+  OUT_JSON = 0,
+  OUT_BINARY = 1
+};
+
+#endif
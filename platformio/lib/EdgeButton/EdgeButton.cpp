@@ -0,0 +1,155 @@
+/**
+  Interrupt driven button for the USB Tester, see EdgeButton.h
+*/
+#include "EdgeButton.h"
+
+struct btnEdgeT {
+  uint16_t ms;      //millis() low bits
+  bool level;       //Pressed after the edge
+};
+
+static volatile btnEdgeT btnQueue[BTN_QUEUE];
+static volatile uint8_t btnHead = 0;
+static volatile uint8_t btnTail = 0;
+static volatile bool btnQueued = false; //Level of the last queued edge
+static bool btnActiveHigh = true;
+
+//Decoder state
+static bool btnLevel = false;       //Level after the last decoded edge
+static uint16_t btnSince = 0;       //Time of the last decoded edge
+static bool btnPressed = false;     //Debounced state
+static int8_t btnCount = 0;         //Short clicks in the current series
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+
+static volatile uint8_t *btnPort;
+static uint8_t btnMask;
+
+static bool btnRead() {
+  return ((*btnPort & btnMask) != 0) == btnActiveHigh;
+}
+
+ISR(PCINT0_vect) {
+  btnEdge(btnRead(), millis());
+}
+
+/**
+ * Enables the pin change interrupt of the button pin, PCINT0-7 (port B) on the 32u4
+ *
+ * @param uint8 Arduino pin, bool true if pressed reads high
+ * @return none
+ */
+void btnBegin(uint8_t pin, bool activeHigh) {
+  btnActiveHigh = activeHigh;
+  pinMode(pin, INPUT);
+  btnPort = portInputRegister(digitalPinToPort(pin));
+  btnMask = digitalPinToBitMask(pin);
+  btnLevel = btnPressed = btnQueued = btnRead();
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  PCIFR = _BV(digitalPinToPCICRbit(pin));
+  *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+}
+#else
+#include "native.h"
+
+static uint8_t btnPin;
+
+static bool btnRead() {
+  return (digitalRead(btnPin) == HIGH) == btnActiveHigh;
+}
+
+static void btnTick(uint64_t now_us) {
+  if (btnRead() != btnQueued) btnEdge(btnRead(), now_us / 1000);
+}
+
+//native_reset() clears the tickers, setup() runs after it
+void btnBegin(uint8_t pin, bool activeHigh) {
+  btnPin = pin;
+  btnActiveHigh = activeHigh;
+  btnHead = btnTail = 0;
+  btnLevel = btnPressed = btnQueued = btnRead();
+  btnCount = 0;
+  native_add_ticker(btnTick);
+}
+#endif
+
+/**
+ * Queues an edge, called from the pin change interrupt
+ *
+ * @param bool pressed after the edge, uint16 millis() of the edge
+ * @return none
+ */
+void btnEdge(bool level, uint16_t ms) {
+  if (level == btnQueued) return;   //Both edges of a short glitch went by before we looked
+  uint8_t next = (btnHead + 1) & (BTN_QUEUE - 1);
+  if (next == btnTail) return;
+  btnQueue[btnHead].ms = ms;
+  btnQueue[btnHead].level = level;
+  btnHead = next;
+  btnQueued = level;
+}
+
+/**
+ * Debounce: a level that held for BTN_DEBOUNCE_MS becomes the pressed state,
+ * each press counts a click
+ */
+static void btnSettle(uint16_t now) {
+  if (btnLevel != btnPressed && (uint16_t)(now - btnSince) > BTN_DEBOUNCE_MS) {
+    btnPressed = btnLevel;
+    if (btnPressed && btnCount < 127) btnCount++;
+  }
+}
+
+/**
+ * Ends a series of clicks once the release or a press lasted long enough
+ */
+static int8_t btnClicks(uint16_t now) {
+  int8_t clicks = 0;
+  uint16_t held = now - btnSince;
+  if (!btnPressed && btnLevel == btnPressed && btnCount && held > BTN_MULTI_MS) {
+    clicks = btnCount;
+    btnCount = 0;
+  } else if (btnPressed && btnLevel == btnPressed && btnCount && held > BTN_LONG_MS) {
+    clicks = -btnCount;
+    btnCount = 0;
+  }
+  return clicks;
+}
+
+/**
+ * Decodes the queued edges, call often enough to keep the queue from filling
+ *
+ * @param none
+ * @return int8 n short clicks, -n when the last one was held, 0 nothing new
+ */
+int8_t btnUpdate() {
+  while (btnTail != btnHead) {
+    uint16_t ms = btnQueue[btnTail].ms;
+    //A series that ended before this edge is reported first, the edge waits
+    btnSettle(ms);
+    int8_t clicks = btnClicks(ms);
+    if (clicks) return clicks;
+    btnLevel = btnQueue[btnTail].level;
+    btnSince = ms;
+    btnTail = (btnTail + 1) & (BTN_QUEUE - 1);
+  }
+  uint16_t now = millis();
+  //An edge dropped on a full queue leaves the level wrong until the next one, the pin tells
+  noInterrupts();
+  if (btnTail == btnHead && btnRead() != btnQueued) btnEdge(btnRead(), now);
+  interrupts();
+  if (btnTail != btnHead) return 0;
+  btnSettle(now);
+  return btnClicks(now);
+}
+
+/**
+ * Debounced state
+ *
+ * @param none
+ * @return bool true while pressed
+ */
+bool btnDown() {
+  return btnPressed;
+}
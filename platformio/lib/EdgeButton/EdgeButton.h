@@ -0,0 +1,38 @@
+/**
+  Interrupt driven button for the USB Tester
+
+  A pin change interrupt stamps every edge of the button with millis() into
+  a small queue, btnUpdate() in the main loop decodes the queue into clicks
+  with the same codes ClickButton used: n short clicks once the button has
+  been released for BTN_MULTI_MS, -n for a press held BTN_LONG_MS.
+
+  The decoder works on the edge times rather than the time it runs, a press
+  and release that both happen during a long display frame still count as
+  a click and the timings do not depend on how often the loop gets there.
+  Bounces shorter than BTN_DEBOUNCE_MS are ignored. If the queue fills up
+  the newest edges are dropped, once it is empty again the decoder goes by
+  the pin level.
+
+  On the host a ticker of the virtual clock watches the pin instead of the
+  interrupt, at every Timer1 tick.
+*/
+
+#ifndef EDGEBUTTON_H
+#define EDGEBUTTON_H
+
+#include <Arduino.h>
+
+//Edges in the queue, power of two
+#define BTN_QUEUE         8
+#define BTN_DEBOUNCE_MS   20
+//Release time that ends a series of clicks
+#define BTN_MULTI_MS      250
+//Press time of a long click
+#define BTN_LONG_MS       2000
+
+void btnBegin(uint8_t pin, bool activeHigh);
+void btnEdge(bool level, uint16_t ms);
+int8_t btnUpdate();
+bool btnDown();
+
+#endif
@@ -0,0 +1,144 @@
+/**
+  Binary framed output for the USB Tester, see Frame.h for the wire format
+*/
+#include "Frame.h"
+#ifdef __AVR__
+#include <util/crc16.h>
+#endif
+
+Frame::Frame() {
+  _len = 0;
+  _overflow = false;
+}
+
+/**
+ * Starts a new frame, discarding anything not yet sent
+ *
+ * @param uint8 frame type, uint8 sequence number of this frame
+ * @return none
+ */
+void Frame::begin(uint8_t type, uint8_t seq) {
+  _buf[0] = FRAME_VERSION;
+  _buf[1] = type;
+  _buf[2] = seq;
+  _len = FRAME_HEADER_SIZE;
+  _overflow = false;
+}
+
+void Frame::put8(uint8_t value) {
+  if (_len >= FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD) {
+    _overflow = true;
+    return;
+  }
+  _buf[_len++] = value;
+}
+
+void Frame::put16(uint16_t value) {
+  put8(value & 0xFF);
+  put8(value >> 8);
+}
+
+void Frame::put32(uint32_t value) {
+  put16(value & 0xFFFF);
+  put16(value >> 16);
+}
+
+/**
+ * LEB128 style varint, 7 bits per byte, high bit set on all but the last byte
+ * 
+ * @param uint16 value, 1 to 3 bytes on the wire
+ * @return none
+ */
+void Frame::putVarint(uint16_t value) {
+  while (value >= 0x80) {
+    put8((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  put8(value);
+}
+
+/**
+ * Zigzag maps small signed values to small unsigned ones (0,-1,1,-2 -> 0,1,2,3)
+ * so deltas close to zero take a single varint byte
+ * 
+ * @param int16 value
+ * @return none
+ */
+void Frame::putZigzag(int16_t value) {
+  putVarint(((uint16_t)value << 1) ^ (uint16_t)(value >> 15));
+}
+
+/**
+ * Print interface, lets text replies be wrapped in a FRAME_TEXT frame
+ *
+ * @param uint8 byte to append to payload
+ * @return 1 if stored, 0 if payload is full
+ */
+size_t Frame::write(uint8_t c) {
+  put8(c);
+  return _overflow ? 0 : 1;
+}
+
+/**
+ * Appends the CRC, COBS encodes and writes the frame with its delimiter
+ * Each run between zero bytes goes out in one write to keep USB calls down
+ *
+ * @param Print to send the frame to
+ * @return number of bytes written, 0 if payload had overflowed and nothing was sent
+ */
+size_t Frame::end(Print &out) {
+  if (_overflow) return 0;
+  uint16_t crc = crc16(_buf, _len);
+  _buf[_len++] = crc & 0xFF;
+  _buf[_len++] = crc >> 8;
+
+  size_t n = 0;
+  uint8_t start = 0;
+  while (start <= _len) {
+    uint8_t end = start;
+    while (end < _len && _buf[end] != 0) end++;
+    //Code byte is distance to next zero (or end of frame) plus one
+    n += out.write((uint8_t)(end - start + 1));
+    if (end > start) n += out.write(&_buf[start], end - start);
+    start = end + 1;
+  }
+  n += out.write((uint8_t)FRAME_DELIMITER);
+  _len = 0;
+  return n;
+}
+
+/**
+ * CRC-16/MCRF4XX, same as avr-libc _crc_ccitt_update() seeded with 0xFFFF
+ *
+ * @param data, length and running crc
+ * @return updated crc
+ */
+uint16_t Frame::crc16(const uint8_t *data, uint8_t len, uint16_t crc) {
+  while (len--) {
+#ifdef __AVR__
+    crc = _crc_ccitt_update(crc, *data++);
+#else
+    uint8_t d = *data++ ^ (crc & 0xFF);
+    d ^= d << 4;
+    crc = ((((uint16_t)d << 8) | (crc >> 8)) ^ (uint8_t)(d >> 4) ^ ((uint16_t)d << 3));
+#endif
+  }
+  return crc;
+}
+
+/**
+ * Decodes one COBS block (without the 0x00 delimiter), for host side tools
+ *
+ * @param encoded bytes, their length and destination of at least len bytes
+ * @return decoded length, 0 if the block is malformed
+ */
+uint8_t Frame::cobsDecode(const uint8_t *src, uint8_t len, uint8_t *dst) {
+  uint8_t in = 0, out = 0;
+  while (in < len) {
+    uint8_t code = src[in++];
+    if (code == 0 || in + code - 1 > len) return 0;
+    for (uint8_t i = 1; i < code; i++) dst[out++] = src[in++];
+    if (code < 0xFF && in < len) dst[out++] = 0;
+  }
+  return out;
+}
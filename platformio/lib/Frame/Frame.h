@@ -0,0 +1,66 @@
+/**
+  Binary framed output for the USB Tester
+
+  Frames are small binary records sent next to (or instead of) the JSON output,
+  for hosts that want integer values at high rates.
+
+  Wire format, before encoding:
+    [0] FRAME_VERSION
+    [1] frame type (frameType)
+    [2] sequence number, per frame type, wraps at 255
+    [3..n] payload, little-endian integers
+    [n+1..n+2] CRC-16/MCRF4XX (poly 0x1021 reflected, init 0xFFFF) of bytes 0..n, little-endian
+
+  The whole record is COBS encoded so it contains no zero bytes, and terminated
+  with a single 0x00 delimiter. A host resyncs after loss by discarding up to the
+  next 0x00.
+*/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <Arduino.h>
+
+#define FRAME_VERSION       1
+//Largest payload of one frame, keep under 254 so COBS needs one code byte per frame
+//Sized for the longest JSON reply (T: with full counters) wrapped in a FRAME_TEXT frame
+#define FRAME_MAX_PAYLOAD   112
+#define FRAME_HEADER_SIZE   3
+#define FRAME_CRC_SIZE      2
+#define FRAME_DELIMITER     0x00
+
+enum frameType {
+  FRAME_TEXT = 0,   //JSON text, used for command replies while in binary mode
+  FRAME_STATS = 1,  //Periodic stats report, same data as the JSON report
+  FRAME_EVENT = 2,  //Threshold/percent event
+  FRAME_RAW = 3,    //Every acquired sample, delta + zigzag varint encoded
+  FRAME_DUMP = 4,   //Chunk of a buffer dump, offset + uint16 values
+  FRAME_TYPES       //Number of frame types, keep last
+};
+
+class Frame : public Print
+{
+  public:
+    Frame();
+    void begin(uint8_t type, uint8_t seq);
+    void put8(uint8_t value);
+    void put16(uint16_t value);
+    void put32(uint32_t value);
+    void putVarint(uint16_t value);
+    void putZigzag(int16_t value);
+    virtual size_t write(uint8_t c);
+    using Print::write;
+    bool overflow() { return _overflow; }
+    uint8_t length() { return _len; }
+    size_t end(Print &out);
+
+    static uint16_t crc16(const uint8_t *data, uint8_t len, uint16_t crc = 0xFFFF);
+    static uint8_t cobsDecode(const uint8_t *src, uint8_t len, uint8_t *dst);
+
+  private:
+    uint8_t _buf[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE];
+    uint8_t _len;
+    bool _overflow;
+};
+
+#endif
@@ -141,6 +141,7 @@ void INA219::ina219SetCalibration_32V_2A(void)
                     INA219_CONFIG_BADCRES_12BIT |
                     INA219_CONFIG_SADCRES_12BIT_1S_532US |
                     INA219_CONFIG_MODE_SANDBVOLT_CONTINUOUS;
+  ina219_config = config;
   wireWriteRegister(INA219_REG_CONFIG, config);
 }
 
@@ -232,6 +233,7 @@ void INA219::ina219SetCalibration_32V_1A(void)
                     INA219_CONFIG_BADCRES_12BIT |
                     INA219_CONFIG_SADCRES_12BIT_1S_532US |
                     INA219_CONFIG_MODE_SANDBVOLT_CONTINUOUS;
+  ina219_config = config;
   wireWriteRegister(INA219_REG_CONFIG, config);
 }
 
@@ -248,6 +250,7 @@ void INA219::ina219SetCalibration_16V_400mA(void){
           INA219_CONFIG_BADCRES_12BIT |
           INA219_CONFIG_SADCRES_12BIT_1S_532US |
           INA219_CONFIG_MODE_SANDBVOLT_CONTINUOUS;
+  ina219_config = config;
   wireWriteRegister(INA219_REG_CONFIG, config);
   
 }
@@ -261,6 +264,7 @@ INA219::INA219(uint8_t addr) {
   ina219_i2caddr = addr;
   ina219_currentDivider_mA = 0;
   ina219_powerDivider_mW = 0;
+  ina219_config = 0;
 }
 
 /**************************************************************************/
@@ -361,4 +365,42 @@ int16_t INA219::getCurrent_mA() {
   
 }
 
+/**************************************************************************/
+/*! 
+    @brief  Sets the conversion speed, range and gain stay as calibrated.
+            INA219_SPEED_CURRENT leaves the register pointer on the current
+            register, so getCurrentFast_mA is a single 2 byte read. The first
+            conversion is ready one conversion time after the switch
+*/
+/**************************************************************************/
+void INA219::setSpeed(uint8_t speed) {
+  uint16_t config = ina219_config;
+  if (speed != INA219_SPEED_NORMAL) {
+    config = (ina219_config & (INA219_CONFIG_BVOLTAGERANGE_MASK | INA219_CONFIG_GAIN_MASK)) |
+             INA219_CONFIG_SADCRES_9BIT_1S_84US;
+    // 9-bit bus is 0000, INA219_CONFIG_BADCRES_9BIT (0001) is 10-bit in the datasheet
+    if (speed == INA219_SPEED_FAST) config |= INA219_CONFIG_MODE_SANDBVOLT_CONTINUOUS;
+    else config |= INA219_CONFIG_MODE_SVOLT_CONTINUOUS;
+  }
+  wireWriteRegister(INA219_REG_CONFIG, config);
+  if (speed == INA219_SPEED_CURRENT) {
+    Wire.beginTransmission(ina219_i2caddr);
+    Wire.write(INA219_REG_CURRENT);
+    Wire.endTransmission();
+  }
+}
 
+/**************************************************************************/
+/*! 
+    @brief  Current in mA from the register the pointer was left on by
+            setSpeed(INA219_SPEED_CURRENT), no pointer write and no float math
+*/
+/**************************************************************************/
+int16_t INA219::getCurrentFast_mA() {
+  Wire.requestFrom(ina219_i2caddr, (uint8_t)2);
+  uint8_t msb = Wire.read();
+  //Rounded in 32 bit, value + half overflows int (16 bit on the AVR) near full scale
+  int32_t value = (int16_t)((msb << 8) | Wire.read());
+  int32_t half = ina219_currentDivider_mA / 2;
+  return (value + (value < 0 ? -half : half)) / (int32_t)ina219_currentDivider_mA;
+}
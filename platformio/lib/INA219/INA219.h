@@ -18,6 +18,14 @@
     #define INA219_READ                            (0x01)
 /*=========================================================================*/
 
+/*=========================================================================
+    CONVERSION SPEEDS (setSpeed)
+    -----------------------------------------------------------------------*/
+    #define INA219_SPEED_NORMAL                    (0)       // Calibration config, 12-bit shunt and bus, 1.06ms
+    #define INA219_SPEED_FAST                      (1)       // 9-bit shunt and bus, 168us
+    #define INA219_SPEED_CURRENT                   (2)       // 9-bit shunt only, 84us, for getCurrentFast_mA
+/*=========================================================================*/
+
 /*=========================================================================
     CONFIG REGISTER (R/W)
     -----------------------------------------------------------------------*/
@@ -102,9 +110,13 @@ class INA219{
   int16_t getBusVoltage_V(void);
   int16_t getShuntVoltage_mV(void);
   int16_t getCurrent_mA(void);
+  void setSpeed(uint8_t speed);
+  int16_t getCurrentFast_mA(void);
 
  private:
   uint8_t ina219_i2caddr;
+  // Config written by the calibration, INA219_SPEED_NORMAL
+  uint16_t ina219_config;
   // The following multipliers are used to convert raw current and power
   // values to mA and mW, taking into account the current config settings
   uint32_t ina219_currentDivider_mA;
@@ -0,0 +1,62 @@
+/**
+  SRAM probe for the USB Tester, see MemProbe.h
+*/
+#include "MemProbe.h"
+
+#ifdef __AVR__
+extern uint8_t __data_start;
+extern uint8_t _end;
+extern uint8_t __stack;
+extern char *__brkval;
+
+/**
+ * Paints free SRAM from the end of .bss to the top of RAM, runs from .init3:
+ * after the stack pointer is set up, before .data/.bss are initialised and
+ * before anything is called, so no C here, only registers
+ */
+void memPaint(void) __attribute__ ((naked, used, section (".init3")));
+void memPaint(void) {
+  __asm volatile (
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, %0\n"
+    "    ldi r25, hi8(__stack)\n"
+    "    rjmp 2f\n"
+    "1:  st Z+, r24\n"
+    "2:  cpi r30, lo8(__stack)\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+    "    breq 1b\n"
+    :: "M" (MEM_PAINT));
+}
+
+static uint8_t *memBottom() {
+  return __brkval ? (uint8_t *)__brkval : &_end;
+}
+
+uint16_t memFree() {
+  uint8_t top;
+  return &top - memBottom();
+}
+
+/**
+ * Counts up from the globals until the first byte the stack has written,
+ * a few cycles per free byte (about 10k with 1.5k free), keep it out of the sampling ISR
+ *
+ * @param none
+ * @return uint16 painted bytes
+ */
+uint16_t memLowest() {
+  const uint8_t *p = memBottom();
+  while (p <= &__stack && *p == MEM_PAINT) p++;
+  return p - memBottom();
+}
+
+uint16_t memStatic() {
+  return &_end - &__data_start;
+}
+#else
+uint16_t memFree() { return 0; }
+uint16_t memLowest() { return 0; }
+uint16_t memStatic() { return 0; }
+#endif
@@ -0,0 +1,28 @@
+/**
+  SRAM probe for the USB Tester
+
+  The 32u4 has 2560 bytes of SRAM: globals (.data, .bss) from the bottom,
+  the stack from the top, down towards them. There is no heap in use.
+  Before the C runtime starts, everything between the end of the globals
+  and the top of RAM is filled with MEM_PAINT. Stack that was ever used
+  has been overwritten, so counting the bytes still painted above the
+  globals gives the least free SRAM since boot (the stack high-water mark).
+
+  Host builds have no AVR memory layout, all values are 0 there.
+*/
+
+#ifndef MEMPROBE_H
+#define MEMPROBE_H
+
+#include <Arduino.h>
+
+#define MEM_PAINT 0xC5
+
+//Bytes between the globals (or heap) and the stack pointer right now
+uint16_t memFree();
+//Least free bytes since boot, painted bytes the stack has never reached
+uint16_t memLowest();
+//Bytes used by globals, .data and .bss
+uint16_t memStatic();
+
+#endif
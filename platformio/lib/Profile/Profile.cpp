@@ -0,0 +1,123 @@
+/**
+  Profiling zones for the USB Tester, see Profile.h
+*/
+#include "Profile.h"
+
+#ifdef PROFILE
+profEntry profTable[PROF_ZONES];
+static volatile uint32_t profIsrCycles = 0; //All cycles spent in the ISR zone so far
+
+static const char profNames[] PROGMEM =
+  "isr\0loop\0drain\0flush\0stats\0format\0cmd\0"
+  "s0\0s1\0s2\0s3\0s4\0s5\0s6\0s7\0";
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+
+static volatile uint16_t profHigh = 0;
+
+ISR(TIMER3_OVF_vect) {
+  profHigh++;
+}
+
+/**
+ * Starts Timer3 at clk/1 in normal mode, the overflow interrupt costs
+ * about 30 cycles every 65536
+ *
+ * @param none
+ * @return none
+ */
+void profInit() {
+  TCCR3A = 0;
+  TCCR3B = _BV(CS30);
+  TCNT3 = 0;
+  TIFR3 = _BV(TOV3);
+  TIMSK3 = _BV(TOIE3);
+  profReset();
+}
+
+/**
+ * Cycles since profInit(), wraps after 268s
+ *
+ * @param none
+ * @return uint32 cycles
+ */
+uint32_t profCycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t low = TCNT3;
+  uint16_t high = profHigh;
+  //Overflowed since interrupts went off, the ISR has not counted it yet
+  if ((TIFR3 & _BV(TOV3)) && low < 0x8000) high++;
+  SREG = sreg;
+  return ((uint32_t)high << 16) | low;
+}
+#else
+void profInit() { profReset(); }
+uint32_t profCycles() { return micros() * (F_CPU / 1000000UL); }
+#endif
+
+/**
+ * Start of a loop zone, the ISR total is taken out so only the zone's own time counts
+ *
+ * @param none
+ * @return uint32 start to pass to profEnd()
+ */
+uint32_t profStart() {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t start = profCycles() - profIsrCycles;
+  SREG = sreg;
+  return start;
+}
+
+static void profAdd(uint8_t zone, uint32_t cycles) {
+  profEntry &e = profTable[zone];
+  if (e.count == 0xFFFF) return;
+  if (!e.count || cycles < e.min) e.min = cycles;
+  if (cycles > e.max) e.max = cycles;
+  e.sum += cycles;
+  e.count++;
+}
+
+void profEnd(uint8_t zone, uint32_t start) {
+  uint8_t sreg = SREG;
+  cli();
+  profAdd(zone, profCycles() - profIsrCycles - start);
+  SREG = sreg;
+}
+
+/**
+ * End of the ISR zone, its time is also kept so loop zones can leave it out
+ *
+ * @param uint8 zone, uint32 start from profCycles()
+ * @return none
+ */
+void profIsrEnd(uint8_t zone, uint32_t start) {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t cycles = profCycles() - start;
+  profIsrCycles += cycles;
+  profAdd(zone, cycles);
+  SREG = sreg;
+}
+
+void profReset() {
+  uint8_t sreg = SREG;
+  cli();
+  memset(profTable, 0, sizeof(profTable));
+  SREG = sreg;
+}
+
+/**
+ * Zone name for the dump
+ *
+ * @param uint8 zone
+ * @return PROGMEM string
+ */
+const char *profName(uint8_t zone) {
+  const char *p = profNames;
+  while (zone--) p += strlen_P(p) + 1;
+  return p;
+}
+#endif
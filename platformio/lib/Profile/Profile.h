@@ -0,0 +1,65 @@
+/**
+  Profiling zones for the USB Tester
+
+  Build with -DPROFILE (pio run -e profile) to time named zones of the hot
+  paths in CPU cycles. Timer3 counts every cycle and its overflow extends
+  it to 32 bits, so zones of any length are measured to the cycle without a
+  scope on a debug pin. Each zone keeps count, min, max and the sum for the
+  average, H: in the firmware dumps the table. Timer3 is otherwise unused,
+  only tone() would need it.
+
+  Zones are inclusive of zones nested in them (stats includes format), time
+  spent in the sampling ISR is taken out of the others. Without PROFILE the
+  macros are empty and nothing here is compiled in.
+
+  Host builds count micros() of the virtual clock instead (x16), only time
+  that passes in delay() and the like shows up there.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <Arduino.h>
+
+enum profZone {
+  PROF_ISR = 0,     //Sampling ISR, readADCs() and readInrush()
+  PROF_LOOP,        //One pass of loop()
+  PROF_DRAIN,       //TxBuffer::drain() with bytes to send
+  PROF_FLUSH,       //Writes into the USB endpoint
+  PROF_STATS,       //Stats report, serialOutput()
+  PROF_FORMAT,      //Building the report, template or frame
+  PROF_CMD,         //One command, processInput()
+  PROF_SCREEN,      //One page of screen 0, PROF_SCREEN + n for screen n
+  PROF_ZONES = PROF_SCREEN + 8
+};
+
+struct profEntry {
+  uint16_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+};
+
+#ifdef PROFILE
+#define PROF_BEGIN(t)            uint32_t t = profStart()
+#define PROF_END(t, zone)        profEnd((zone), t)
+#define PROF_ISR_BEGIN(t)        uint32_t t = profCycles()
+#define PROF_ISR_END(t, zone)    profIsrEnd((zone), t)
+#else
+#define PROF_BEGIN(t)
+#define PROF_END(t, zone)
+#define PROF_ISR_BEGIN(t)
+#define PROF_ISR_END(t, zone)
+#endif
+
+extern profEntry profTable[PROF_ZONES];
+
+void profInit();
+uint32_t profCycles();
+uint32_t profStart();
+void profEnd(uint8_t zone, uint32_t start);
+void profIsrEnd(uint8_t zone, uint32_t start);
+void profReset();
+const char *profName(uint8_t zone);
+
+#endif
@@ -0,0 +1,96 @@
+/**
+  Cooperative task scheduler for the USB Tester, see Scheduler.h
+*/
+#include "Scheduler.h"
+
+Scheduler::Scheduler(const schedTask *tasks, schedStats *stats, uint8_t count) {
+  _tasks = tasks;
+  _stats = stats;
+  _count = min(count, SCHED_MAX_TASKS);
+}
+
+/**
+ * Orders the tasks by priority and starts their periods now
+ * 
+ * @param none
+ * @return none
+ */
+void Scheduler::begin() {
+  for (uint8_t i = 0; i < _count; i++) {
+    //Insertion sort, equal priorities keep table order
+    uint8_t prio = pgm_read_byte(&_tasks[i].priority);
+    uint8_t j = i;
+    while (j && pgm_read_byte(&_tasks[_order[j - 1]].priority) > prio) {
+      _order[j] = _order[j - 1];
+      j--;
+    }
+    _order[j] = i;
+  }
+  reset();
+}
+
+/**
+ * One pass, runs the due tasks by priority
+ * 
+ * @param none
+ * @return bool true if a task wants to run again on the next pass
+ */
+bool Scheduler::run() {
+  uint32_t now = millis();
+  bool again = false;
+  for (uint8_t i = 0; i < _count; i++) {
+    uint8_t t = _order[i];
+    schedStats &s = _stats[t];
+    uint16_t since = (uint16_t)now - s.last;
+    if (!s.again) {
+      uint16_t period = pgm_read_word(&_tasks[t].period);
+      if (since < period) continue;
+      if (since - period > pgm_read_word(&_tasks[t].deadline) && s.missed != 0xFFFF) s.missed++;
+    }
+    schedFn fn = (schedFn)pgm_read_ptr(&_tasks[t].run);
+    uint32_t start = micros();
+    s.again = fn(now);
+    again |= s.again;
+    uint32_t took = micros() - start;
+    s.last = now;
+    if (took > 0xFFFF) took = 0xFFFF;
+    if (took > s.max) s.max = took;
+    if (s.runs == 0xFFFF) {
+      s.runs >>= 1;
+      s.sum >>= 1;
+    }
+    s.runs++;
+    s.sum += took;
+  }
+  return again;
+}
+
+/**
+ * Clears the stats, periods start again now
+ * 
+ * @param none
+ * @return none
+ */
+void Scheduler::reset() {
+  uint16_t now = millis();
+  for (uint8_t i = 0; i < _count; i++) {
+    bool again = _stats[i].again;
+    memset(&_stats[i], 0, sizeof(schedStats));
+    _stats[i].last = now;
+    _stats[i].again = again;
+  }
+}
+
+uint8_t Scheduler::count() {
+  return _count;
+}
+
+/**
+ * Task name for the stats dump
+ * 
+ * @param uint8 task index in the table
+ * @return PROGMEM string
+ */
+const char *Scheduler::name(uint8_t task) {
+  return (const char *)pgm_read_ptr(&_tasks[task].name);
+}
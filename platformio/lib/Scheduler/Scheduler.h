@@ -0,0 +1,65 @@
+/**
+  Cooperative task scheduler for the USB Tester
+
+  loop() calls run() once per pass. Each pass runs every task that is due
+  in priority order, a task is due when period ms have passed since its
+  last run (0 runs it on every pass) or when it asked to be called again.
+  Tasks never block: long work such as a display frame is done a slice
+  per call, the task returns true until it is finished and every other
+  task still gets its turn between slices.
+
+  run() returns false when no task asked to be called again, the caller
+  may then sleep until the next interrupt brings new work.
+
+  A run that starts more than deadline ms after the task was due counts as
+  missed. Runtime is measured with micros() around each call, avg and max
+  per task show which one holds the others up.
+
+  The task table is const and stays in flash, only the stats are in RAM.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#define SCHED_MAX_TASKS 8
+
+//Returns true to be called again on the next pass
+typedef bool (*schedFn)(uint32_t now);
+
+struct schedTask {
+  const char *name;     //PROGMEM
+  schedFn run;
+  uint16_t period;      //ms between runs, 0 runs on every pass
+  uint16_t deadline;    //ms a run may start after it was due before it counts as missed
+  uint8_t priority;     //Lower runs first in a pass
+};
+
+struct schedStats {
+  uint16_t last;        //millis() low bits at the last run
+  uint16_t runs;        //Runs in the average, halved together with sum when full
+  uint32_t sum;         //us of those runs
+  uint16_t max;         //Longest run in us, saturates
+  uint16_t missed;      //Runs that started past the deadline, saturates
+  bool again;           //Asked to be called on the next pass
+};
+
+class Scheduler
+{
+  public:
+    Scheduler(const schedTask *tasks, schedStats *stats, uint8_t count);
+    void begin();
+    bool run();
+    void reset();
+    uint8_t count();
+    const char *name(uint8_t task);
+
+  private:
+    const schedTask *_tasks;
+    schedStats *_stats;
+    uint8_t _count;
+    uint8_t _order[SCHED_MAX_TASKS];  //Task indexes by priority
+};
+
+#endif
@@ -0,0 +1,118 @@
+/**
+  Non-blocking buffered serial transmitter, see TxBuffer.h
+*/
+#include "TxBuffer.h"
+#include "Profile.h"
+
+TxBuffer::TxBuffer(Print &out) : _out(out) {
+  _head = _tail = _commit = 0;
+  _cls = TX_REPLY;
+  _wide = false;
+  _overflow = false;
+  _urgent = false;
+  _since = 0;
+  memset(dropped, 0, sizeof(dropped));
+  memset(seq, 0, sizeof(seq));
+}
+
+/**
+ * Starts a message, everything written until end() is sent or dropped as one
+ * 
+ * @param uint8 message class (txClass)
+ * @return none
+ */
+void TxBuffer::begin(uint8_t cls) {
+  _head = _commit;
+  _cls = cls;
+  _wide = (_commit == _tail);
+  _overflow = false;
+}
+
+/**
+ * Free bytes a message of this class may still use
+ * 
+ * @param uint8 message class (txClass)
+ * @return free bytes
+ */
+uint8_t TxBuffer::room(uint8_t cls) {
+  uint8_t free = (TX_BUFFER_SIZE - 1) - (uint8_t)(_head - _tail);
+  if (cls >= TX_STATS) return free > TX_RESERVE ? free - TX_RESERVE : 0;
+  return free;
+}
+
+size_t TxBuffer::write(uint8_t c) {
+  if (_overflow || !room(_wide ? TX_REPLY : _cls)) {
+    _overflow = true;
+    return 0;
+  }
+  _buf[_head++] = c;
+  return 1;
+}
+
+size_t TxBuffer::write(const uint8_t *buffer, size_t size) {
+  if (_overflow || size > room(_wide ? TX_REPLY : _cls)) {
+    _overflow = true;
+    return 0;
+  }
+  for (size_t i = 0; i < size; i++) _buf[_head++] = buffer[i];
+  return size;
+}
+
+/**
+ * Completes a message, rolls it back if it did not fit
+ * Either way the message used up its sequence number, so the host sees the gap
+ * 
+ * @param none
+ * @return true if the message is queued, false if dropped
+ */
+bool TxBuffer::end() {
+  seq[_cls]++;
+  if (_overflow) {
+    _head = _commit;
+    if (dropped[_cls] != 0xFFFF) dropped[_cls]++;
+    return false;
+  }
+  if (_commit == _tail) _since = millis();
+  if (_cls < TX_STATS) _urgent = true;
+  _commit = _head;
+  return true;
+}
+
+/**
+ * Sends as much as the port takes right now, never waits
+ * Holds a partial packet back until more is queued or it gets urgent/old
+ * Call often, any time outside begin()/end()
+ * 
+ * @param none
+ * @return none
+ */
+void TxBuffer::drain() {
+  if (_tail == _commit) return;
+  if (pending() < TX_PACKET - 1 && !_urgent && (uint8_t)((uint8_t)millis() - _since) < TX_FLUSH_MS) return;
+  PROF_BEGIN(profDrain);
+  while (_tail != _commit) {
+    //Stay one byte short of a full bank, see TxBuffer.h
+    int space = _out.availableForWrite() - 1;
+    if (space <= 0) break;
+    //Contiguous bytes up to commit or the end of the ring
+    uint16_t n = (_commit > _tail) ? _commit - _tail : TX_BUFFER_SIZE - _tail;
+    if (n > (uint16_t)space) n = space;
+    PROF_BEGIN(profFlush);
+    n = _out.write(&_buf[_tail], n);
+    PROF_END(profFlush, PROF_FLUSH);
+    if (!n) break;
+    _tail += n;
+  }
+  if (_tail == _commit) _urgent = false;
+  PROF_END(profDrain, PROF_DRAIN);
+}
+
+/**
+ * Bytes queued and not yet sent
+ * 
+ * @param none
+ * @return number of bytes
+ */
+uint8_t TxBuffer::pending() {
+  return _commit - _tail;
+}
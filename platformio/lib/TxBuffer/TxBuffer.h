@@ -0,0 +1,81 @@
+/**
+  Non-blocking buffered serial transmitter for the USB Tester
+
+  Messages are written into a RAM ring buffer between begin() and end() and
+  only go out when drain() finds room in the USB endpoint, so a host that stops
+  reading never stalls the main loop.
+
+  Each message has a class. Replies and events may use the whole buffer,
+  periodic classes (stats, raw samples, telemetry) must leave TX_RESERVE bytes
+  free so a reply or event can still get through behind them. A periodic
+  message that starts on an empty buffer may use the reserve too, a stats
+  report with every field is longer than what the reserve leaves. A message
+  that does not fit is rolled back and counted in dropped[].
+
+  Events are not guaranteed: nothing is evicted to make room and end() never
+  waits, an event that does not fit in what is left is dropped like any other
+  message. The reserve holds short replies, an event line (about 110 bytes)
+  needs more, so it gets through once the host has read what is queued
+  ahead of it. dropped[TX_EVENT] and the gap in the event "seq" show a loss.
+
+  drain() coalesces output into USB sized packets: it waits until a packet's
+  worth is queued, a reply or event is waiting, or the oldest byte is
+  TX_FLUSH_MS old. It never fills the endpoint bank completely, on the AVR core
+  a write ending on the bank boundary releases it with an extra zero length
+  packet and may wait for the second bank. The SOF interrupt sends the partly
+  filled bank within 1ms.
+*/
+
+#ifndef TXBUFFER_H
+#define TXBUFFER_H
+
+#include <Arduino.h>
+
+//Must stay 256, indexes wrap as uint8_t
+#define TX_BUFFER_SIZE    256
+//Room kept free for replies and events
+#define TX_RESERVE        64
+//CDC bulk IN endpoint size on the 32u4
+#define TX_PACKET         64
+//Longest a partial packet is held back waiting for more data
+#define TX_FLUSH_MS       5
+
+enum txClass {
+  TX_REPLY = 0,     //Command replies, may use the whole buffer
+  TX_EVENT = 1,     //Events, may use the whole buffer, still dropped when that is full
+  TX_STATS = 2,     //Periodic stats, caller coalesces into the next report when dropped
+  TX_RAW = 3,       //Raw samples and buffer dumps
+  TX_TELEM = 4,     //Telemetry
+  TX_CLASSES        //Number of classes, keep last
+};
+
+class TxBuffer : public Print
+{
+  public:
+    TxBuffer(Print &out);
+    void begin(uint8_t cls);
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    bool end();
+    void drain();
+    uint8_t pending();
+    uint8_t room(uint8_t cls);
+
+    uint16_t dropped[TX_CLASSES];   //Messages rolled back per class, saturates
+    uint16_t seq[TX_CLASSES];       //Sequence number of the next message per class, counts dropped ones too, wraps
+
+  private:
+    Print &_out;
+    uint8_t _buf[TX_BUFFER_SIZE];
+    uint8_t _head;      //Next byte written
+    uint8_t _tail;      //Next byte sent
+    uint8_t _commit;    //End of last complete message, drain() stops here
+    uint8_t _cls;
+    bool _wide;         //Current message started on an empty buffer, may use the reserve
+    bool _overflow;
+    bool _urgent;       //Reply or event queued, send without waiting for a full packet
+    uint8_t _since;     //millis() low byte when the oldest queued message was committed
+};
+
+#endif
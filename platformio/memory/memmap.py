@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Flash and SRAM per subsystem from an avr-ld map file: memmap.py firmware.map
+
+Every input section the linker kept is put in a subsystem by the file it
+came from and its name. The firmware is built with -ffunction-sections
+and -fdata-sections (and U8glib gives each font its own section), so a
+section is one function or variable and buffers in main.cpp can be told
+apart. .data counts for flash (initial values) and SRAM.
+
+Prints one line per subsystem and the totals against the 32u4: 28672
+bytes of flash next to the Caterina bootloader and 2560 bytes of SRAM,
+what globals leave of it is for the stack (see M: at runtime). Exits
+with 1 when flash is over or globals leave less than STACK_RESERVE,
+memreport.py runs it after every leonardo link so such an image fails
+the build.
+"""
+import re
+import sys
+
+FLASH_SIZE = 28672
+SRAM_SIZE = 2560
+# Room for the deepest call chain (a display page, stats formatting and
+# the sample ISR on top of it), M: "l" shows what is really left
+STACK_RESERVE = 512
+
+# (subsystem, pattern on "section file"), first match wins
+RULES = [
+    ("U8glib fonts", r"u8g_font"),
+    ("U8glib", r"[Uu]8g"),
+    ("INA219", r"INA219"),
+    ("EEPROMex", r"EEPROM"),
+    ("Graph buffers", r"\.(graph_Mem|graph_Mem_ORG|autoscale_\w+) .*main\.cpp"),
+    ("Capture/raw buffers", r"\.(capture_\w+|raw_\w+|dump_\w+|inrush_\w+) .*main\.cpp"),
+    ("Serial output", r"Frame\.cpp|TxBuffer|\.(tx|frame|frameSeq|input_\w+) .*main\.cpp"),
+    ("Serial/USB core", r"CDC|USBCore|PluggableUSB|HardwareSerial|Print\.cpp|Stream\.cpp|WString"),
+    ("Wire", r"Wire|twi"),
+    ("TimerOne", r"TimerOne"),
+    ("Button", r"EdgeButton"),
+    ("MemProbe", r"MemProbe"),
+    ("Firmware", r"main\.cpp"),
+    ("Arduino core", r"FrameworkArduino|framework-arduino"),
+    ("libc/libgcc", r"lib(c|gcc|m)\.a|avr-libc|crtatmega|crtm"),
+]
+
+FLASH = re.compile(r"^\.(text|progmem|vectors|init\d|fini\d|trampolines|jumptables|lowtext|ctors|dtors)")
+DATA = re.compile(r"^\.(data|rodata)")
+BSS = re.compile(r"^(\.(bss|noinit)|COMMON)")
+ENTRY = re.compile(r"^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+
+
+def sections(lines):
+    """(section, size, file) of every input section in the memory map part"""
+    started = False
+    pending = None
+    for line in lines:
+        if not started:
+            started = line.startswith("Linker script and memory map")
+            continue
+        line = line.rstrip("\n")
+        # Long section names go on a line of their own, the numbers follow
+        if re.match(r"^ [.\w]\S*$", line):
+            pending = line.strip()
+            continue
+        m = ENTRY.match(line)
+        name = (m.group(1) if m else None) or pending
+        pending = None
+        if not m or not name or name.startswith("*"):
+            continue
+        size = int(m.group(3), 16)
+        if size:
+            yield name, size, m.group(4).strip()
+
+
+def subsystem(name, path):
+    key = "%s %s" % (name, path)
+    for sub, pattern in RULES:
+        if re.search(pattern, key):
+            return sub
+    return "Other"
+
+
+def measure(path):
+    """{subsystem: [flash, sram]} from the map file"""
+    totals = {}
+    with open(path) as f:
+        for name, size, path in sections(f):
+            flash = sram = 0
+            if FLASH.match(name):
+                flash = size
+            elif DATA.match(name):
+                flash = sram = size
+            elif BSS.match(name):
+                sram = size
+            else:
+                continue
+            t = totals.setdefault(subsystem(name, path), [0, 0])
+            t[0] += flash
+            t[1] += sram
+    return totals
+
+
+def report(totals):
+    """Prints the breakdown, False when the image is over budget"""
+    flash = sum(t[0] for t in totals.values())
+    sram = sum(t[1] for t in totals.values())
+    print("%-20s %7s %7s" % ("subsystem", "flash", "sram"))
+    for sub, (f, s) in sorted(totals.items(), key=lambda i: -i[1][0] - i[1][1]):
+        print("%-20s %7d %7d" % (sub, f, s))
+    print("%-20s %7d %7d" % ("total", flash, sram))
+    print("flash %d of %d (%.1f%%), %d free" % (flash, FLASH_SIZE, 100.0 * flash / FLASH_SIZE, FLASH_SIZE - flash))
+    print("sram %d of %d (%.1f%%), %d left for the stack" % (sram, SRAM_SIZE, 100.0 * sram / SRAM_SIZE, SRAM_SIZE - sram))
+    ok = True
+    if flash > FLASH_SIZE:
+        print("over budget: flash is %d bytes over" % (flash - FLASH_SIZE))
+        ok = False
+    if sram + STACK_RESERVE > SRAM_SIZE:
+        print("over budget: %d bytes left for the stack, %d needed" % (SRAM_SIZE - sram, STACK_RESERVE))
+        ok = False
+    return ok
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    if not report(measure(sys.argv[1])):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,43 @@
+# Links with a map file and checks it against the 32u4 budget with
+# memory/memmap.py after every link, an image over budget fails the build.
+# pio run -t memreport prints the breakdown per subsystem, it is also kept
+# next to the map
+import os
+import sys
+
+Import("env")
+
+sys.path.insert(0, env.subst("$PROJECT_DIR/memory"))
+import memmap
+
+env.Append(LINKFLAGS=["-Wl,-Map,$BUILD_DIR/${PROGNAME}.map"])
+
+
+def check_budget(source, target, env):
+    mapfile = env.subst("$BUILD_DIR/${PROGNAME}.map")
+    totals = memmap.measure(mapfile)
+    stdout = sys.stdout
+    with open(env.subst("$BUILD_DIR/memreport.txt"), "w") as f:
+        sys.stdout = f
+        try:
+            ok = memmap.report(totals)
+        finally:
+            sys.stdout = stdout
+    if not ok:
+        with open(env.subst("$BUILD_DIR/memreport.txt")) as f:
+            sys.stderr.write(f.read())
+        # Gone so the next build links again instead of taking it as done
+        os.remove(target[0].get_abspath())
+        return 1
+    return 0
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_budget)
+
+env.AddCustomTarget(
+    name="memreport",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=["cat $BUILD_DIR/memreport.txt"],
+    title="Memory report",
+    description="Flash and SRAM per subsystem from the linker map",
+)
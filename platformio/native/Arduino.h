@@ -0,0 +1,133 @@
+/*
+  Host stand-in for the Arduino AVR core as used on the Leonardo (ATmega32u4).
+
+  Time is virtual: millis()/micros() only move when the harness calls
+  native_advance(), which also fires the Timer1 callback at its period,
+  so long scenarios run as fast as the host can execute them.
+*/
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+// Standard containers before the min/max macros below, they clash with <algorithm>
+#include <string>
+#include <vector>
+#include "Print.h"
+#include "avr/pgmspace.h"
+
+#ifndef ARDUINO
+#define ARDUINO 10805
+#endif
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define A0 18
+#define A1 19
+#define SS 17
+#define NUM_PINS 32
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+static inline void sei(void) {}
+static inline void cli(void) {}
+static inline void interrupts(void) {}
+static inline void noInterrupts(void) {}
+
+// AVR I/O registers touched by the firmware, as plain memory
+extern volatile uint8_t PORTB, PORTC, PORTD, PINB, PINC, PIND, DDRB, DDRC, DDRD;
+extern volatile uint8_t ADMUX, ADCL, ADCH;
+
+// ADCSRA needs behaviour: setting ADSC runs a conversion that completes at once
+class NativeADCSRA
+{
+  public:
+    operator uint8_t() const { return value; }
+    NativeADCSRA &operator=(uint8_t v) { value = v; convert(); return *this; }
+    NativeADCSRA &operator|=(uint8_t v) { value |= v; convert(); return *this; }
+    NativeADCSRA &operator&=(uint8_t v) { value &= v; return *this; }
+    uint8_t value = 0x87;
+  private:
+    void convert();
+};
+extern NativeADCSRA ADCSRA;
+extern volatile uint8_t SREG;
+
+// Bit positions (ATmega32u4)
+#define PB6 6
+#define PC7 7
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADSC 6
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define MUX4 4
+#define REFS0 6
+#define REFS1 7
+
+// Core API
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class Serial_ : public Stream
+{
+  public:
+    void begin(unsigned long) {}
+    void end(void) {}
+    virtual int available(void);
+    virtual int peek(void);
+    virtual int read(void);
+    virtual int availableForWrite(void);
+    virtual void flush(void) {}
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    operator bool() { return connected; }
+
+    // Host side of the CDC link
+    bool connected = true;
+    std::string input;          // bytes waiting for the firmware to read
+    size_t inputPos = 0;
+    std::string output;         // everything the firmware sent
+    size_t writeCalls = 0;      // number of write() calls reaching the "endpoint"
+    int txSpace = -1;           // bytes the host will accept, -1 for unlimited
+    // CDC IN endpoint model: 64 byte bank released when full (plus a ZLP when
+    // a write ends exactly on the boundary, as the AVR core does) or at SOF
+    uint8_t bankUsed = 0;
+    size_t packets = 0;
+    size_t zlps = 0;
+    void sof() { if (bankUsed) { packets++; bankUsed = 0; } }
+    void inject(const char *s) { input.append(s); }
+    void inject(const uint8_t *s, size_t n) { input.append((const char *)s, n); }
+};
+extern Serial_ Serial;
+
+#include "native.h"
+
+#endif
@@ -0,0 +1,273 @@
+/*
+  Host model of the INA219, see INA219Model.h
+*/
+#include <stdio.h>
+#include "INA219Model.h"
+
+// Register pointers
+#define REG_CONFIG      0
+#define REG_SHUNT       1
+#define REG_BUS         2
+#define REG_POWER       3
+#define REG_CURRENT     4
+#define REG_CAL         5
+
+#define CONFIG_RESET    0x8000
+#define BUS_CNVR        0x0002
+#define BUS_OVF         0x0001
+
+// Points averaged over each conversion window
+#define AVERAGE_POINTS  16
+
+INA219Model::INA219Model(float shunt_ohm)
+{
+  shunt = shunt_ohm;
+  conversions = reads = staleReads = lastConversions = 0;
+  set(0, 0);
+  reset();
+}
+
+void INA219Model::set(float bus_mV, float current_mA)
+{
+  trace.clear();
+  Point p = {0, current_mA, bus_mV, false};
+  trace.push_back(p);
+  hint = 0;
+  burstPeriod = 0;
+}
+
+void INA219Model::step(uint64_t at_us, float bus_mV, float current_mA)
+{
+  Point p = {at_us, current_mA, bus_mV, false};
+  trace.push_back(p);
+}
+
+void INA219Model::ramp(uint64_t until_us, float bus_mV, float current_mA)
+{
+  Point p = {until_us, current_mA, bus_mV, true};
+  trace.push_back(p);
+}
+
+void INA219Model::burst(uint64_t start_us, uint32_t period_us, uint32_t width_us, float extra_mA, uint32_t count)
+{
+  burstStart = start_us;
+  burstPeriod = period_us;
+  burstWidth = width_us;
+  burstmA = extra_mA;
+  burstCount = count;
+}
+
+bool INA219Model::loadCSV(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  char line[128];
+  float mV = trace.empty() ? 0 : trace.back().mV;
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+    char *p;
+    uint64_t t = strtoull(line, &p, 10);
+    if (*p != ',') continue;
+    float mA = strtod(p + 1, &p);
+    if (*p == ',') mV = strtod(p + 1, &p);
+    step(t, mV, mA);
+  }
+  fclose(f);
+  return true;
+}
+
+// Trace point in effect at t_us, next is the index of the point after it
+const INA219Model::Point &INA219Model::at(uint64_t t_us, size_t &next)
+{
+  if (hint >= trace.size() || trace[hint].t > t_us) hint = 0;
+  while (hint + 1 < trace.size() && trace[hint + 1].t <= t_us) hint++;
+  next = hint + 1;
+  return trace[hint];
+}
+
+float INA219Model::current(uint64_t t_us)
+{
+  size_t next;
+  const Point &p = at(t_us, next);
+  float mA = p.mA;
+  if (next < trace.size() && trace[next].ramp && t_us >= p.t) {
+    const Point &n = trace[next];
+    mA += (n.mA - p.mA) * (float)(t_us - p.t) / (float)(n.t - p.t);
+  }
+  if (burstPeriod && t_us >= burstStart) {
+    uint64_t since = t_us - burstStart;
+    if ((!burstCount || since / burstPeriod < burstCount) && since % burstPeriod < burstWidth) mA += burstmA;
+  }
+  return mA;
+}
+
+float INA219Model::bus(uint64_t t_us)
+{
+  size_t next;
+  const Point &p = at(t_us, next);
+  float mV = p.mV;
+  if (next < trace.size() && trace[next].ramp && t_us >= p.t) {
+    const Point &n = trace[next];
+    mV += (n.mV - p.mV) * (float)(t_us - p.t) / (float)(n.t - p.t);
+  }
+  return mV;
+}
+
+// True if the input does not change between from and to, no step, ramp or burst edge
+bool INA219Model::steady(uint64_t from, uint64_t to)
+{
+  size_t next;
+  at(from, next);
+  if (next < trace.size() && (trace[next].ramp || trace[next].t <= to)) return false;
+  if (!burstPeriod || to < burstStart) return true;
+  if (from < burstStart) return false;
+  uint64_t a = (from - burstStart) / burstPeriod, b = (to - burstStart) / burstPeriod;
+  if (burstCount && a >= burstCount) return true;
+  return a == b && ((from - burstStart) % burstPeriod < burstWidth) == ((to - burstStart) % burstPeriod < burstWidth);
+}
+
+float INA219Model::average(bool volts, uint64_t from, uint64_t to)
+{
+  // Most windows see a constant input, long runs spend their time here
+  if (steady(from, to)) return volts ? bus(from) : current(from);
+  float sum = 0;
+  for (uint8_t i = 0; i < AVERAGE_POINTS; i++) {
+    uint64_t t = from + (to - from) * (2 * i + 1) / (2 * AVERAGE_POINTS);
+    sum += volts ? bus(t) : current(t);
+  }
+  return sum / AVERAGE_POINTS;
+}
+
+/**
+ * Conversion time of one ADC from its 4 config bits (BADC or SADC)
+ *
+ * @param uint8_t adc resolution/averaging bits
+ * @return uint32_t us
+ */
+uint32_t INA219Model::conversionTime(uint8_t adc)
+{
+  static const uint32_t single[4] = {84, 148, 276, 532};
+  static const uint32_t averaged[8] = {532, 1060, 2130, 4260, 8510, 17020, 34050, 68100};
+  return (adc & 0x8) ? averaged[adc & 0x7] : single[adc & 0x3];
+}
+
+void INA219Model::reset()
+{
+  memset(regs, 0, sizeof(regs));
+  regs[REG_CONFIG] = INA219_MODEL_CONFIG_DEFAULT;
+  ptr = 0;
+  start(native_micros);
+}
+
+// (Re)starts conversions for the current config, as a config write does
+void INA219Model::start(uint64_t now)
+{
+  uint16_t config = regs[REG_CONFIG];
+  uint8_t mode = config & 0x7;
+  converting = (mode != 0 && mode != 4);
+  uint32_t cycle = 0;
+  if (mode & 1) cycle += conversionTime((config >> 3) & 0xF);
+  if (mode & 2) cycle += conversionTime((config >> 7) & 0xF);
+  convStart = now;
+  convEnd = now + cycle;
+}
+
+// Completes every conversion due by now, only the latest one ends up in the registers
+void INA219Model::update(uint64_t now)
+{
+  if (now < convStart) start(now); //Virtual clock was reset
+  if (!converting || now < convEnd) return;
+  uint64_t cycle = convEnd - convStart;
+  if (regs[REG_CONFIG] & 0x4) {
+    uint64_t done = (now - convStart) / cycle;
+    uint64_t last = convStart + (done - 1) * cycle;
+    latch(last, last + cycle);
+    conversions += done - 1; //latch() counts the last one
+    convStart += done * cycle;
+    convEnd = convStart + cycle;
+  } else {
+    latch(convStart, convEnd);
+    converting = false;
+  }
+}
+
+// Result of the conversion that ran from start to end
+void INA219Model::latch(uint64_t start, uint64_t end)
+{
+  uint16_t config = regs[REG_CONFIG];
+  uint8_t mode = config & 0x7;
+  uint8_t sadc = (config >> 3) & 0xF;
+  uint8_t badc = (config >> 7) & 0xF;
+  uint64_t busFrom = start;
+  bool ovf = false;
+
+  if (mode & 1) {
+    busFrom = start + conversionTime(sadc);
+    // 10uV LSB, PGA range 40mV << gain, fewer bits leave the low ones at 0
+    int32_t raw = lroundf(average(false, start, busFrom) * shunt * 100);
+    int32_t range = 4000L << ((config >> 11) & 0x3);
+    if (raw > range) { raw = range; ovf = true; }
+    if (raw < -range) { raw = -range; ovf = true; }
+    int32_t q = 1 << ((sadc & 0x8) ? 0 : 3 - (sadc & 0x3));
+    regs[REG_SHUNT] = (uint16_t)(int16_t)(raw / q * q);
+  }
+  if (mode & 2) {
+    // 4mV LSB in bits 15-3, 16V or 32V range
+    int32_t raw = lroundf(average(true, busFrom, end) / 4);
+    int32_t range = (config & 0x2000) ? 8000 : 4000;
+    if (raw > range) raw = range;
+    if (raw < 0) raw = 0;
+    int32_t q = 1 << ((badc & 0x8) ? 0 : 3 - (badc & 0x3));
+    regs[REG_BUS] = (uint16_t)((raw / q * q) << 3);
+  }
+  if (mode & 1) {
+    int32_t current = (int32_t)(int16_t)regs[REG_SHUNT] * regs[REG_CAL] / 4096;
+    if (current > 32767) { current = 32767; ovf = true; }
+    if (current < -32768) { current = -32768; ovf = true; }
+    regs[REG_CURRENT] = (uint16_t)(int16_t)current;
+    int32_t power = labs(current) * (regs[REG_BUS] >> 3) / 5000;
+    if (power > 65535) { power = 65535; ovf = true; }
+    regs[REG_POWER] = power;
+  }
+  regs[REG_BUS] = (regs[REG_BUS] & ~(BUS_CNVR | BUS_OVF)) | BUS_CNVR | (ovf ? BUS_OVF : 0);
+  conversions++;
+}
+
+void INA219Model::writeRegister(uint8_t reg, uint16_t value)
+{
+  if (reg == REG_CONFIG) {
+    if (value & CONFIG_RESET) {
+      reset();
+      return;
+    }
+    regs[REG_CONFIG] = value;
+    regs[REG_BUS] &= ~BUS_CNVR;
+    start(native_micros);
+  } else if (reg == REG_CAL) {
+    regs[REG_CAL] = value & 0xFFFE; //Bit 0 is not used
+  }
+  //Data registers are read only
+}
+
+void INA219Model::receive(const uint8_t *data, uint8_t len)
+{
+  update(native_micros);
+  if (len) ptr = data[0];
+  if (len >= 3) writeRegister(ptr, (data[1] << 8) | data[2]);
+}
+
+uint8_t INA219Model::request(uint8_t *data, uint8_t len)
+{
+  update(native_micros);
+  uint16_t value = ptr < 6 ? regs[ptr] : 0;
+  reads++;
+  if (ptr == REG_CURRENT) {
+    if (conversions == lastConversions) staleReads++;
+    lastConversions = conversions;
+  }
+  //Reading power clears the conversion ready flag
+  if (ptr == REG_POWER) regs[REG_BUS] &= ~BUS_CNVR;
+  data[0] = value >> 8;
+  if (len > 1) data[1] = value & 0xFF;
+  return len > 1 ? 2 : 1;
+}
@@ -0,0 +1,84 @@
+/*
+  Host model of the INA219 on the I2C bus (address 0x40).
+
+  Registers behave as in the datasheet: configuration (with reset),
+  calibration, shunt, bus (CNVR and OVF bits), current and power.
+  Conversions take the time set by the ADC resolution/averaging bits and
+  average the input over their window, in continuous or triggered mode.
+  Registers are brought up to date from the virtual clock on every bus
+  access, so the firmware sees stale values exactly when a real part would.
+
+  The input is a trace of current and bus voltage over virtual time, built
+  from steps, ramps and bursts or loaded from a CSV file.
+*/
+#ifndef NATIVE_INA219_MODEL_H
+#define NATIVE_INA219_MODEL_H
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#define INA219_MODEL_ADDRESS 0x40
+#define INA219_MODEL_CONFIG_DEFAULT 0x399F
+
+class INA219Model : public WireDevice
+{
+  public:
+    INA219Model(float shunt_ohm = 0.1);
+
+    // Input trace, times in us of virtual time (native_micros)
+    // Constant load from time 0, clears the trace and bursts
+    void set(float bus_mV, float current_mA);
+    // Jump to a new load at at_us
+    void step(uint64_t at_us, float bus_mV, float current_mA);
+    // Move linearly from the previous point to this load, reached at until_us
+    void ramp(uint64_t until_us, float bus_mV, float current_mA);
+    // Add extra_mA for width_us every period_us from start_us, count pulses (0 forever)
+    void burst(uint64_t start_us, uint32_t period_us, uint32_t width_us, float extra_mA, uint32_t count = 0);
+    // Lines of t_us,current_mA,bus_mV (bus optional, keeps the last value), '#' comments
+    // Each line is a step, false if the file can't be read
+    bool loadCSV(const char *path);
+    float current(uint64_t t_us);
+    float bus(uint64_t t_us);
+
+    // Register file, regs[0] config ... regs[5] calibration
+    uint16_t regs[6];
+    uint32_t conversions;       // Completed conversions
+    uint32_t reads;             // Register reads by the firmware
+    uint32_t staleReads;        // Reads of the current register with no conversion since the last one
+
+    // WireDevice
+    void receive(const uint8_t *data, uint8_t len);
+    uint8_t request(uint8_t *data, uint8_t len);
+
+    static uint32_t conversionTime(uint8_t adc);
+
+  private:
+    struct Point {
+      uint64_t t;
+      float mA;
+      float mV;
+      bool ramp;
+    };
+    std::vector<Point> trace;
+    size_t hint;                // Trace index of the last lookup, traces are read in time order
+    uint64_t burstStart;
+    uint32_t burstPeriod, burstWidth, burstCount;
+    float burstmA;
+    float shunt;
+
+    uint8_t ptr;
+    bool converting;
+    uint64_t convStart, convEnd;
+    uint32_t lastConversions;
+
+    void reset();
+    void writeRegister(uint8_t reg, uint16_t value);
+    void start(uint64_t now);
+    void update(uint64_t now);
+    void latch(uint64_t start, uint64_t end);
+    const Point &at(uint64_t t_us, size_t &next);
+    bool steady(uint64_t from, uint64_t to);
+    float average(bool volts, uint64_t from, uint64_t to);
+};
+
+#endif
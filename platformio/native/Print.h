@@ -0,0 +1,104 @@
+/*
+  Host stand-in for the Arduino Print class, just enough of
+  the AVR core API for the firmware and its libraries.
+*/
+#ifndef NATIVE_PRINT_H
+#define NATIVE_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+      size_t n = 0;
+      while (size--) n += write(*buffer++);
+      return n;
+    }
+    virtual int availableForWrite() { return 0; }
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+    size_t print(const __FlashStringHelper *s) { return print((const char *)s); }
+    size_t print(const char s[]) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC) {
+      if (base == 0) return write((uint8_t)n);
+      if (base == 10 && n < 0) { size_t t = print('-'); return printNumber(0UL - (unsigned long)n, 10) + t; }
+      return printNumber((unsigned long)n, base);
+    }
+    size_t print(unsigned long n, int base = DEC) {
+      if (base == 0) return write((uint8_t)n);
+      return printNumber(n, base);
+    }
+    size_t print(double n, int digits = 2) { return printFloat(n, digits); }
+
+    size_t println(void) { return write("\r\n"); }
+    template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(T v, int f) { size_t n = print(v, f); return n + println(); }
+
+  private:
+    // Same algorithms as the AVR core so host output is byte-identical
+    size_t printNumber(unsigned long n, uint8_t base) {
+      char buf[8 * sizeof(long) + 1];
+      char *str = &buf[sizeof(buf) - 1];
+      *str = '\0';
+      if (base < 2) base = 10;
+      do {
+        char c = n % base;
+        n /= base;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+      } while (n);
+      return write(str);
+    }
+    size_t printFloat(double number, uint8_t digits) {
+      // The AVR core works in 32-bit float, mirror that
+      float fnumber = (float)number;
+      size_t n = 0;
+      if (isnan(fnumber)) return print("nan");
+      if (isinf(fnumber)) return print("inf");
+      if (fnumber > 4294967040.0f) return print("ovf");
+      if (fnumber < -4294967040.0f) return print("ovf");
+      if (fnumber < 0.0f) { n += print('-'); fnumber = -fnumber; }
+      float rounding = 0.5f;
+      for (uint8_t i = 0; i < digits; ++i) rounding /= 10.0f;
+      fnumber += rounding;
+      unsigned long int_part = (unsigned long)fnumber;
+      float remainder = fnumber - (float)int_part;
+      n += print(int_part);
+      if (digits > 0) n += print('.');
+      while (digits-- > 0) {
+        remainder *= 10.0f;
+        unsigned int toPrint = (unsigned int)remainder;
+        n += print(toPrint);
+        remainder -= toPrint;
+      }
+      return n;
+    }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+#endif
@@ -0,0 +1,5 @@
+/* Host stand-in: the display talks through U8glib's com layer instead */
+#ifndef _SPI_H_INCLUDED
+#define _SPI_H_INCLUDED
+#include "Arduino.h"
+#endif
@@ -0,0 +1,267 @@
+/*
+  Host model of the SSD1306, see SSD1306Model.h
+*/
+#include <stdio.h>
+#include "SSD1306Model.h"
+
+#define MODE_HORIZONTAL 0
+#define MODE_VERTICAL   1
+#define MODE_PAGE       2
+
+SSD1306Model *ssd1306_model = 0;
+
+SSD1306Model::SSD1306Model()
+{
+  u8g = 0;
+  oldCom = 0;
+  reset();
+}
+
+void SSD1306Model::reset()
+{
+  memset(ram, 0, sizeof(ram));
+  memset(&current, 0, sizeof(current));
+  last = total = current;
+  frames = 0;
+  selected = dataMode = false;
+  registers();
+}
+
+// Power on / RES# state from the datasheet, GDDRAM is left alone
+void SSD1306Model::registers()
+{
+  on = invert = allOn = chargePump = false;
+  segRemap = comReverse = false;
+  contrast = 0x7F;
+  startLine = offset = 0;
+  mux = SSD1306_MODEL_HEIGHT - 1;
+  mode = MODE_PAGE;
+  col = page = 0;
+  colStart = pageStart = 0;
+  colEnd = SSD1306_MODEL_WIDTH - 1;
+  pageEnd = SSD1306_MODEL_PAGES - 1;
+  need = argc = 0;
+}
+
+void SSD1306Model::attach(u8g_t *u)
+{
+  detach();
+  u8g = u;
+  oldCom = u8g->dev->com_fn;
+  u8g->dev->com_fn = com;
+  ssd1306_model = this;
+  u8g_Begin(u8g);
+  memset(&current, 0, sizeof(current));
+}
+
+void SSD1306Model::detach()
+{
+  if (u8g) u8g->dev->com_fn = oldCom;
+  if (ssd1306_model == this) ssd1306_model = 0;
+  u8g = 0;
+}
+
+bool SSD1306Model::pixel(uint8_t x, uint8_t y)
+{
+  if (!on) return false;
+  if (allOn) return true;
+  // Modules are wired for segment remap and reversed COM scan (A1, C8),
+  // with those set GDDRAM maps straight onto the image
+  uint8_t c = segRemap ? x : SSD1306_MODEL_WIDTH - 1 - x;
+  uint8_t com = comReverse ? y : SSD1306_MODEL_HEIGHT - 1 - y;
+  if (com > mux) return invert;
+  uint8_t row = (com + offset + startLine) % SSD1306_MODEL_HEIGHT;
+  bool lit = ram[row / 8][c] & (1 << (row % 8));
+  return lit != invert;
+}
+
+std::string SSD1306Model::pbm()
+{
+  std::string out = "P4\n128 64\n";
+  for (uint8_t y = 0; y < SSD1306_MODEL_HEIGHT; y++) {
+    for (uint8_t x = 0; x < SSD1306_MODEL_WIDTH; x += 8) {
+      uint8_t b = 0;
+      for (uint8_t i = 0; i < 8; i++) b = (b << 1) | pixel(x + i, y);
+      out += (char)b;
+    }
+  }
+  return out;
+}
+
+bool SSD1306Model::writePBM(const char *path)
+{
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  std::string img = pbm();
+  bool ok = fwrite(img.data(), 1, img.size(), f) == img.size();
+  return fclose(f) == 0 && ok;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static void be32(std::string &s, uint32_t v)
+{
+  s += (char)(v >> 24); s += (char)(v >> 16); s += (char)(v >> 8); s += (char)v;
+}
+
+static void chunk(std::string &png, const char *type, const std::string &data)
+{
+  std::string c = std::string(type) + data;
+  be32(png, data.size());
+  png += c;
+  be32(png, crc32(0, (const uint8_t *)c.data(), c.size()));
+}
+
+// 1 bit grayscale, one stored (uncompressed) deflate block, the image is only 1088 bytes
+bool SSD1306Model::writePNG(const char *path)
+{
+  std::string raw;
+  for (uint8_t y = 0; y < SSD1306_MODEL_HEIGHT; y++) {
+    raw += (char)0; //Filter none
+    for (uint8_t x = 0; x < SSD1306_MODEL_WIDTH; x += 8) {
+      uint8_t b = 0;
+      for (uint8_t i = 0; i < 8; i++) b = (b << 1) | pixel(x + i, y);
+      raw += (char)b;
+    }
+  }
+  std::string ihdr;
+  be32(ihdr, SSD1306_MODEL_WIDTH);
+  be32(ihdr, SSD1306_MODEL_HEIGHT);
+  ihdr += std::string("\x01\x00\x00\x00\x00", 5);
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < raw.size(); i++) {
+    a = (a + (uint8_t)raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  std::string z = "\x78\x01\x01";
+  z += (char)(raw.size() & 0xFF); z += (char)(raw.size() >> 8);
+  z += (char)(~raw.size() & 0xFF); z += (char)((~raw.size() >> 8) & 0xFF);
+  z += raw;
+  be32(z, (b << 16) | a);
+  std::string png = "\x89PNG\r\n\x1a\n";
+  chunk(png, "IHDR", ihdr);
+  chunk(png, "IDAT", z);
+  chunk(png, "IEND", "");
+
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(png.data(), 1, png.size(), f) == png.size();
+  return fclose(f) == 0 && ok;
+}
+
+void SSD1306Model::command(uint8_t b)
+{
+  current.commands++;
+  total.commands++;
+  if (need) {
+    if (argc < sizeof(args)) args[argc] = b;
+    argc++;
+    if (--need) return;
+    switch (cmd) {
+      case 0x20: mode = args[0] & 0x3; break;
+      case 0x21: colStart = col = args[0] & 0x7F; colEnd = args[1] & 0x7F; break;
+      case 0x22: pageStart = page = args[0] & 0x7; pageEnd = args[1] & 0x7; break;
+      case 0x81: contrast = args[0]; break;
+      case 0x8D: chargePump = args[0] & 0x04; break;
+      case 0xA8: if (args[0] >= 15) mux = args[0] & 0x3F; break;
+      case 0xD3: offset = args[0] & 0x3F; break;
+    }
+    return;
+  }
+  cmd = b;
+  argc = 0;
+  // U8glib moves the pointers with the page mode commands in horizontal
+  // mode as well and the panel follows, so they apply in every mode
+  if (b <= 0x0F) col = (col & 0xF0) | b;
+  else if (b <= 0x1F) col = ((b & 0x07) << 4) | (col & 0x0F);
+  else if (b >= 0x40 && b <= 0x7F) startLine = b & 0x3F;
+  else if (b >= 0xB0 && b <= 0xB7) page = b & 0x07;
+  else switch (b) {
+    case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+    case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+      need = 1; break;
+    case 0x21: case 0x22: case 0xA3:
+      need = 2; break;
+    case 0x26: case 0x27:
+      need = 6; break;
+    case 0x29: case 0x2A:
+      need = 5; break;
+    case 0xA0: case 0xA1: segRemap = b & 1; break;
+    case 0xA4: case 0xA5: allOn = b & 1; break;
+    case 0xA6: case 0xA7: invert = b & 1; break;
+    case 0xAE: case 0xAF: on = b & 1; break;
+    case 0xC0: comReverse = false; break;
+    case 0xC8: comReverse = true; break;
+  }
+}
+
+void SSD1306Model::write(uint8_t b)
+{
+  current.data++;
+  total.data++;
+  current.pages |= 1 << page;
+  ram[page][col] = b;
+  if (mode == MODE_PAGE) {
+    col = (col + 1) % SSD1306_MODEL_WIDTH;
+  } else if (mode == MODE_HORIZONTAL) {
+    if (col++ >= colEnd) {
+      col = colStart;
+      page = (page >= pageEnd) ? pageStart : page + 1;
+    }
+  } else {
+    if (page++ >= pageEnd) {
+      page = pageStart;
+      col = (col >= colEnd) ? colStart : col + 1;
+    }
+  }
+}
+
+void SSD1306Model::endFrame()
+{
+  current.at = native_micros;
+  last = current;
+  frames++;
+  memset(&current, 0, sizeof(current));
+}
+
+uint8_t SSD1306Model::com(u8g_t *u8g, uint8_t msg, uint8_t arg_val, void *arg_ptr)
+{
+  SSD1306Model *m = ssd1306_model;
+  if (!m) return 1;
+  switch (msg) {
+    case U8G_COM_MSG_RESET:
+      if (!arg_val) m->registers();
+      break;
+    case U8G_COM_MSG_CHIP_SELECT:
+      m->selected = arg_val;
+      if (!arg_val && (m->current.pages & (1 << (SSD1306_MODEL_PAGES - 1)))) m->endFrame();
+      break;
+    case U8G_COM_MSG_ADDRESS:
+      m->dataMode = arg_val;
+      break;
+    case U8G_COM_MSG_WRITE_BYTE: {
+      uint8_t b = arg_val;
+      return com(u8g, U8G_COM_MSG_WRITE_SEQ, 1, &b);
+    }
+    case U8G_COM_MSG_WRITE_SEQ:
+    case U8G_COM_MSG_WRITE_SEQ_P:
+      if (!m->selected) break;
+      for (uint8_t i = 0; i < arg_val; i++) {
+        uint8_t b = (msg == U8G_COM_MSG_WRITE_SEQ_P) ? u8g_pgm_read((uint8_t *)arg_ptr + i) : ((uint8_t *)arg_ptr)[i];
+        m->current.bytes++;
+        m->total.bytes++;
+        if (m->dataMode) m->write(b);
+        else m->command(b);
+      }
+      break;
+  }
+  return 1;
+}
@@ -0,0 +1,78 @@
+/*
+  Host model of the SSD1306 128x64 OLED behind U8glib's com layer.
+
+  attach() swaps the com procedure of the firmware's U8glib device for
+  this model and replays the init sequence. Command bytes are decoded as
+  in the datasheet (addressing modes, column/page pointers, remap, scan
+  direction, start line, offset, contrast, invert, on/off), data bytes
+  land in the 128x64 GDDRAM.
+
+  Every byte is counted. A frame ends when the chip is deselected after
+  the bottom page was written, its numbers are kept in last and the panel
+  image can be exported as PBM or PNG for golden image tests.
+*/
+#ifndef NATIVE_SSD1306_MODEL_H
+#define NATIVE_SSD1306_MODEL_H
+
+#include <string>
+#include "Arduino.h"
+#include <U8glib.h>
+
+#define SSD1306_MODEL_WIDTH 128
+#define SSD1306_MODEL_HEIGHT 64
+#define SSD1306_MODEL_PAGES (SSD1306_MODEL_HEIGHT / 8)
+
+class SSD1306Model
+{
+  public:
+    struct Frame {
+      uint32_t bytes;           // Bytes on the bus, commands and data
+      uint32_t commands;        // Command bytes, arguments included
+      uint32_t data;            // GDDRAM bytes
+      uint8_t pages;            // Bit n set if page n got data
+      uint64_t at;              // native_micros when the frame ended
+    };
+
+    SSD1306Model();
+    void reset();
+    // Take over the com procedure of u8g's device and run its init again
+    void attach(u8g_t *u8g);
+    void detach();
+
+    // Pixel as seen on the panel, with remap, scan direction, offset, invert and on/off
+    bool pixel(uint8_t x, uint8_t y);
+    // Lit pixels are 1 (black) in PBM and white in PNG, false if the file can't be written
+    bool writePBM(const char *path);
+    bool writePNG(const char *path);
+    // Panel image as a P4 PBM in memory, for comparisons
+    std::string pbm();
+
+    uint8_t ram[SSD1306_MODEL_PAGES][SSD1306_MODEL_WIDTH];
+    bool on, invert, allOn, chargePump;
+    bool segRemap, comReverse;
+    uint8_t contrast, startLine, offset, mux, mode;
+
+    Frame current;              // Frame in progress
+    Frame last;                 // Last complete frame
+    Frame total;                // Everything since reset(), pages unused
+    uint32_t frames;
+
+    static uint8_t com(u8g_t *u8g, uint8_t msg, uint8_t arg_val, void *arg_ptr);
+
+  private:
+    void registers();
+    void command(uint8_t b);
+    void write(uint8_t b);
+    void endFrame();
+
+    u8g_t *u8g;
+    u8g_com_fnptr oldCom;
+    bool selected, dataMode;
+    uint8_t col, page;
+    uint8_t colStart, colEnd, pageStart, pageEnd;
+    uint8_t cmd, args[2], argc, need;
+};
+
+extern SSD1306Model *ssd1306_model;
+
+#endif
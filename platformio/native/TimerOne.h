@@ -0,0 +1,31 @@
+/*
+  Host stand-in for PaulStoffregen's TimerOne: the callback is fired by
+  native_advance() whenever the virtual clock crosses a period boundary.
+*/
+#ifndef TimerOne_h_
+#define TimerOne_h_
+
+#include "Arduino.h"
+
+class TimerOne
+{
+  public:
+    void initialize(unsigned long microseconds = 1000000) { setPeriod(microseconds); }
+    void setPeriod(unsigned long microseconds) { period = microseconds; next = native_micros + period; }
+    void start() { running = true; next = native_micros + period; }
+    void stop() { running = false; }
+    void restart() { start(); }
+    void resume() { running = true; }
+    void attachInterrupt(void (*isr)()) { isrCallback = isr; running = true; next = native_micros + period; }
+    void attachInterrupt(void (*isr)(), unsigned long microseconds) { setPeriod(microseconds); attachInterrupt(isr); }
+    void detachInterrupt() { isrCallback = 0; }
+
+    unsigned long period = 1000000;
+    uint64_t next = 0;
+    bool running = false;
+    void (*isrCallback)() = 0;
+    uint32_t fired = 0;
+};
+extern TimerOne Timer1;
+
+#endif
@@ -0,0 +1,53 @@
+/*
+  Host stand-in for the Arduino TwoWire master. Transactions are routed
+  to device models registered with Wire.attach().
+*/
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+class WireDevice
+{
+  public:
+    virtual ~WireDevice() {}
+    // Master wrote bytes in one transaction
+    virtual void receive(const uint8_t *data, uint8_t len) = 0;
+    // Master requests len bytes
+    virtual uint8_t request(uint8_t *data, uint8_t len) = 0;
+};
+
+class TwoWire : public Stream
+{
+  public:
+    void begin() {}
+    void setClock(uint32_t clock) { clockHz = clock; }
+    void beginTransmission(uint8_t address) { txAddress = address; txLen = 0; }
+    void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+    uint8_t endTransmission(uint8_t sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop = true);
+    uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t)address, (uint8_t)quantity); }
+    virtual size_t write(uint8_t c) { if (txLen >= BUFFER_LENGTH) return 0; txBuf[txLen++] = c; return 1; }
+    using Print::write;
+    virtual int available() { return rxLen - rxPos; }
+    virtual int read() { return rxPos < rxLen ? rxBuf[rxPos++] : -1; }
+    virtual int peek() { return rxPos < rxLen ? rxBuf[rxPos] : -1; }
+
+    // Host side
+    void attach(uint8_t address, WireDevice *dev) { devices[address & 0x7F] = dev; }
+    uint32_t clockHz = 100000;
+    uint32_t transactions = 0;
+    uint32_t bytesOnBus = 0;
+  private:
+    WireDevice *devices[128] = {0};
+    uint8_t txAddress = 0;
+    uint8_t txBuf[BUFFER_LENGTH];
+    uint8_t txLen = 0;
+    uint8_t rxBuf[BUFFER_LENGTH];
+    uint8_t rxLen = 0, rxPos = 0;
+};
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,41 @@
+/* Host stand-in for the AVR EEPROM API, backed by a RAM array */
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define E2END 0x3FF
+
+extern uint8_t native_eeprom[E2END + 1];
+
+static inline uint8_t eeprom_is_ready(void) { return 1; }
+static inline uint8_t eeprom_read_byte(const uint8_t *a) { return native_eeprom[(size_t)a & E2END]; }
+static inline uint16_t eeprom_read_word(const uint16_t *a) {
+  size_t p = (size_t)a;
+  return native_eeprom[p & E2END] | (native_eeprom[(p + 1) & E2END] << 8);
+}
+static inline unsigned long eeprom_read_dword(const unsigned long *a) {
+  size_t p = (size_t)a;
+  return eeprom_read_word((const uint16_t *)p) | ((unsigned long)eeprom_read_word((const uint16_t *)(p + 2)) << 16);
+}
+static inline void eeprom_write_byte(uint8_t *a, uint8_t v) { native_eeprom[(size_t)a & E2END] = v; }
+static inline void eeprom_write_word(uint16_t *a, uint16_t v) {
+  size_t p = (size_t)a;
+  native_eeprom[p & E2END] = v & 0xFF;
+  native_eeprom[(p + 1) & E2END] = v >> 8;
+}
+static inline void eeprom_write_dword(unsigned long *a, unsigned long v) {
+  size_t p = (size_t)a;
+  eeprom_write_word((uint16_t *)p, v & 0xFFFF);
+  eeprom_write_word((uint16_t *)(p + 2), v >> 16);
+}
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n) {
+  for (size_t i = 0; i < n; i++) ((uint8_t *)dst)[i] = native_eeprom[((size_t)src + i) & E2END];
+}
+static inline void eeprom_write_block(const void *src, void *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) native_eeprom[((size_t)dst + i) & E2END] = ((const uint8_t *)src)[i];
+}
+
+#endif
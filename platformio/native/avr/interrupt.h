@@ -0,0 +1,2 @@
+/* Host stand-in, everything the firmware needs is in Arduino.h */
+#include "Arduino.h"
@@ -0,0 +1,25 @@
+/* Host stand-in: flash and RAM share one address space */
+#ifndef NATIVE_PGMSPACE_H
+#define NATIVE_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_byte_near(addr) pgm_read_byte(addr)
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_word_near(addr) pgm_read_word(addr)
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strcmp_P strcmp
+#define strchr_P strchr
+#define memcpy_P memcpy
+
+typedef uint8_t prog_uchar;
+
+#endif
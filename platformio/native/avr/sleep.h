@@ -0,0 +1,14 @@
+/* Host stand-in, sleep_cpu() returns at once, virtual time only moves in native_advance() */
+#ifndef NATIVE_SLEEP_H
+#define NATIVE_SLEEP_H
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE 0
+
+static inline void set_sleep_mode(uint8_t mode) { (void)mode; }
+static inline void sleep_enable(void) {}
+static inline void sleep_disable(void) {}
+static inline void sleep_cpu(void) {}
+
+#endif
@@ -0,0 +1,172 @@
+/*
+  Host implementation of the Arduino core stand-ins and the virtual clock.
+*/
+#include "Arduino.h"
+#include "Wire.h"
+#include "TimerOne.h"
+#include "avr/eeprom.h"
+
+uint64_t native_micros = 0;
+int native_analog[NUM_PINS];
+uint8_t native_pins[NUM_PINS];
+uint16_t native_vcc_mV = 5000;
+uint8_t native_eeprom[E2END + 1];
+
+volatile uint8_t PORTB, PORTC, PORTD, PINB, PINC, PIND, DDRB, DDRC, DDRD;
+volatile uint8_t ADMUX, ADCL, ADCH;
+volatile uint8_t SREG;
+NativeADCSRA ADCSRA;
+
+Serial_ Serial;
+TwoWire Wire;
+TimerOne Timer1;
+
+static native_tick_fn tickers[8];
+static uint8_t tickerCount = 0;
+
+void NativeADCSRA::convert()
+{
+  if (!(value & _BV(ADSC))) return;
+  // Only the bandgap-against-AVcc channel used by readVcc() is modelled here
+  uint16_t result = (uint16_t)((1100UL * 1023UL) / (native_vcc_mV ? native_vcc_mV : 1));
+  ADCL = result & 0xFF;
+  ADCH = result >> 8;
+  value &= ~_BV(ADSC);
+}
+
+void native_add_ticker(native_tick_fn fn)
+{
+  if (tickerCount < sizeof(tickers) / sizeof(tickers[0])) tickers[tickerCount++] = fn;
+}
+
+static void runTickers()
+{
+  for (uint8_t i = 0; i < tickerCount; i++) tickers[i](native_micros);
+}
+
+// USB start of frame every 1ms flushes a partly filled CDC bank
+static void sofUntil(uint64_t t)
+{
+  if (t / 1000 != native_micros / 1000) Serial.sof();
+}
+
+void native_advance(uint32_t us)
+{
+  uint64_t target = native_micros + us;
+  while (Timer1.running && Timer1.isrCallback && Timer1.period && Timer1.next <= target) {
+    sofUntil(Timer1.next);
+    native_micros = Timer1.next;
+    Timer1.next += Timer1.period;
+    runTickers();
+    Timer1.fired++;
+    Timer1.isrCallback();
+  }
+  sofUntil(target);
+  native_micros = target;
+  runTickers();
+}
+
+void native_reset(uint64_t start_us)
+{
+  native_micros = start_us;
+  memset(native_analog, 0, sizeof(native_analog));
+  memset(native_pins, 0, sizeof(native_pins));
+  native_vcc_mV = 5000;
+  Serial.input.clear();
+  Serial.inputPos = 0;
+  Serial.output.clear();
+  Serial.writeCalls = 0;
+  Serial.bankUsed = 0;
+  Serial.packets = 0;
+  Serial.zlps = 0;
+  Serial.txSpace = -1;
+  Serial.connected = true;
+  Timer1.running = false;
+  Timer1.isrCallback = 0;
+  Timer1.fired = 0;
+  tickerCount = 0;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  if (pin < NUM_PINS) native_pins[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pin < NUM_PINS ? native_pins[pin] : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+  return pin < NUM_PINS ? native_analog[pin] : 0;
+}
+
+unsigned long millis(void) { return (unsigned long)(uint32_t)(native_micros / 1000); }
+unsigned long micros(void) { return (unsigned long)(uint32_t)native_micros; }
+void delay(unsigned long ms) { native_advance(ms * 1000UL); }
+void delayMicroseconds(unsigned int us) { native_advance(us); }
+
+int Serial_::available(void) { return (int)(input.size() - inputPos); }
+int Serial_::peek(void) { return inputPos < input.size() ? (uint8_t)input[inputPos] : -1; }
+int Serial_::read(void) { return inputPos < input.size() ? (uint8_t)input[inputPos++] : -1; }
+
+int Serial_::availableForWrite(void)
+{
+  if (!connected) return 0;
+  int space = 64 - bankUsed;
+  if (txSpace >= 0 && txSpace < space) return txSpace;
+  return space;
+}
+
+size_t Serial_::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t Serial_::write(const uint8_t *buffer, size_t size)
+{
+  if (!connected) return 0;
+  writeCalls++;
+  if (txSpace >= 0) {
+    if ((size_t)txSpace < size) size = txSpace;
+    txSpace -= size;
+  }
+  output.append((const char *)buffer, size);
+  for (size_t left = size; left; ) {
+    size_t n = 64 - bankUsed;
+    if (n > left) n = left;
+    bankUsed += n;
+    left -= n;
+    if (bankUsed == 64) {
+      packets++;
+      bankUsed = 0;
+      if (!left) zlps++;
+    }
+  }
+  return size;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t)
+{
+  transactions++;
+  bytesOnBus += txLen + 1;
+  WireDevice *dev = devices[txAddress & 0x7F];
+  if (!dev) return 2; // address NACK
+  dev->receive(txBuf, txLen);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t)
+{
+  transactions++;
+  rxLen = rxPos = 0;
+  if (quantity > BUFFER_LENGTH) quantity = BUFFER_LENGTH;
+  WireDevice *dev = devices[address & 0x7F];
+  if (!dev) return 0;
+  rxLen = dev->request(rxBuf, quantity);
+  bytesOnBus += rxLen + 1;
+  return rxLen;
+}
@@ -0,0 +1,27 @@
+/*
+  Harness controls for the host build: virtual clock, pin and ADC inputs.
+*/
+#ifndef NATIVE_HARNESS_H
+#define NATIVE_HARNESS_H
+
+#include <stdint.h>
+
+extern uint64_t native_micros;
+extern int native_analog[NUM_PINS];
+extern uint8_t native_pins[NUM_PINS];
+extern uint16_t native_vcc_mV;
+
+// Called whenever virtual time moves forward, lets peripheral models update
+typedef void (*native_tick_fn)(uint64_t now_us);
+void native_add_ticker(native_tick_fn fn);
+
+// Advance virtual time, firing timer callbacks that fall due
+void native_advance(uint32_t us);
+// Reset the virtual clock and all host-side state
+void native_reset(uint64_t start_us = 0);
+
+// Firmware entry points
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,69 @@
+/*
+  Standalone host run of the firmware, built by pio run -e native:
+    .pio/build/native/program [seconds] [commands] [trace.csv] [frame.pbm|png] [frame_s]
+  Runs setup()/loop() on the virtual clock against a 5V 500mA load, or the
+  INA219Model CSV trace, and writes everything the firmware sends over
+  serial to stdout. commands are sent once setup() is done, separated with ';'
+  The last display frame is saved to frame.pbm (or .png) and the display
+  traffic goes to stderr. With frame_s and a printf pattern for the frame,
+  e.g. screens/%06u.png, a frame is saved every frame_s seconds instead,
+  numbered by the second it was taken (replay/replay.py uses this).
+
+  Unit tests (pio test -e native) and the fuzzer (fuzz/) bring their own main().
+*/
+#if !defined(PIO_UNIT_TESTING) && !defined(FUZZING)
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "Wire.h"
+#include "INA219Model.h"
+#include "SSD1306Model.h"
+
+extern U8GLIB_SSD1306_128X64 display;
+
+// PNG for a .png path, PBM otherwise, path may hold a printf pattern for the second
+static bool saveFrame(SSD1306Model &oled, const char *pattern, uint32_t second)
+{
+  char path[256];
+  snprintf(path, sizeof(path), pattern, second);
+  const char *ext = strrchr(path, '.');
+  bool ok = (ext && !strcmp(ext, ".png")) ? oled.writePNG(path) : oled.writePBM(path);
+  if (!ok) fprintf(stderr, "can't write %s\n", path);
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t seconds = argc > 1 ? strtoul(argv[1], NULL, 10) : 10;
+  const char *framePath = argc > 4 ? argv[4] : NULL;
+  uint32_t frameSeconds = argc > 5 ? strtoul(argv[5], NULL, 10) : 0;
+  bool series = framePath && frameSeconds && strchr(framePath, '%');
+  INA219Model ina;
+  SSD1306Model oled;
+  native_reset();
+  ina.set(5000, 500);
+  if (argc > 3 && argv[3][0] && !ina.loadCSV(argv[3])) {
+    fprintf(stderr, "can't read %s\n", argv[3]);
+    return 1;
+  }
+  Wire.attach(INA219_MODEL_ADDRESS, &ina);
+  oled.attach(display.getU8g());
+  setup();
+  if (argc > 2) {
+    Serial.inject(argv[2]);
+    Serial.inject("\n");
+  }
+  // One loop per ms of virtual time, the sampling ISR fires on its own period
+  for (uint32_t i = 0; i < seconds * 1000; i++) {
+    loop();
+    native_advance(1000);
+    if (series && (i + 1) % (frameSeconds * 1000) == 0 && !saveFrame(oled, framePath, (i + 1) / 1000)) return 1;
+  }
+  fwrite(Serial.output.data(), 1, Serial.output.size(), stdout);
+  fprintf(stderr, "display: %u frames, %u bytes, last frame %u bytes (%u commands, %u data)\n",
+    oled.frames, oled.total.bytes, oled.last.bytes, oled.last.commands, oled.last.data);
+  if (framePath && !series && !saveFrame(oled, framePath, seconds)) return 1;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,225 @@
+#!/usr/bin/env python3
+"""Replays a recorded log through the native firmware build.
+
+    replay.py [options] log out_dir
+
+log is either the JSON lines the firmware sends (as saved by the Java
+logger, anything before the first '{' on a line is ignored) or a raw
+binary capture of the serial stream with FRAME_RAW frames (A:1), told
+apart by the 0x00 frame delimiters.
+
+The log is turned into an INA219Model trace (out_dir/trace.csv) and the
+native program (pio run -e native) runs it on the virtual clock, far
+faster than real time. What the firmware sent goes to out_dir/serial.log,
+split into reports.jsonl and events.jsonl, and with --screens the display
+is saved every few seconds to out_dir/screens.
+
+Stats reports only hold max, min and avg per period, each period is
+rebuilt as a level that keeps the average with 1ms at the peak and 1ms at
+the minimum, peak current at the lowest voltage. Energy, peaks and
+thresholds survive, the shape inside a period does not. Raw captures are
+replayed sample by sample.
+"""
+import argparse
+import json
+import os
+import struct
+import subprocess
+import sys
+
+FRAME_VERSION = 1
+FRAME_RAW = 3
+# Sampling starts with setup(), the first report covers the first period after reset
+BOOT_MS = 0
+
+
+def crc16(data):
+    """CRC-16/MCRF4XX as in lib/Frame"""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def varints(data):
+    value, shift = 0, 0
+    for b in data:
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            yield value
+            value, shift = 0, 0
+
+
+def zigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def raw_samples(data, rate_ms):
+    """(ms, mA, mV) for every sample in the FRAME_RAW frames of a capture"""
+    for chunk in data.split(b"\x00"):
+        frame = cobs_decode(chunk) if chunk else None
+        if not frame or len(frame) < 9 or frame[0] != FRAME_VERSION or frame[1] != FRAME_RAW:
+            continue
+        if crc16(frame[:-2]) != struct.unpack("<H", frame[-2:])[0]:
+            continue
+        seq = struct.unpack("<I", frame[3:7])[0]
+        mA = mV = 0
+        deltas = [zigzag(v) for v in varints(frame[7:-2])]
+        for i in range(0, len(deltas) - 1, 2):
+            mA = (mA + deltas[i]) & 0xFFFF
+            mV = (mV + deltas[i + 1]) & 0xFFFF
+            yield seq * rate_ms, mA, mV
+            seq += 1
+
+
+def stats_periods(lines, period_ms):
+    """(start ms, length ms, report) for every stats report in a JSON log"""
+    t = 0
+    last = None
+    for line in lines:
+        start = line.find("{")
+        if start < 0:
+            continue
+        try:
+            r = json.loads(line[start:])
+        except ValueError:
+            continue
+        if not isinstance(r.get("a"), dict) or not isinstance(r.get("v"), dict):
+            continue
+        length = period_ms
+        if "time" in r and last is not None and r["time"] > last:
+            length = r["time"] - last
+        last = r.get("time")
+        yield t, length, r
+        t += length
+
+
+def period_points(start, length, r):
+    """Trace steps (ms, mA, mV) rebuilding one stats period"""
+    a, v = r["a"], r["v"]
+    mA = (a["max"], a["min"], a["avg"])
+    mV = (v["max"] * 1000, v["min"] * 1000, v["avg"] * 1000)
+    if length < 4 or (mA[0] == mA[1] and mV[0] == mV[1]):
+        return [(start, mA[2], mV[2])]
+    # Level that keeps the average with one ms at max and one at min
+    def level(hi, lo, avg):
+        return min(max((avg * length - hi - lo) / (length - 2), lo), hi)
+    base = (level(*mA), level(*mV))
+    return [
+        (start, base[0], base[1]),
+        (start + length // 3, mA[0], mV[1]),
+        (start + length // 3 + 1, base[0], base[1]),
+        (start + 2 * length // 3, mA[1], mV[0]),
+        (start + 2 * length // 3 + 1, base[0], base[1]),
+    ]
+
+
+def build_trace(args):
+    """Writes out_dir/trace.csv, returns (points, length ms, log summary)"""
+    with open(args.log, "rb") as f:
+        data = f.read()
+    points = []
+    summary = {}
+    # Frames end with 0x00, which JSON text never has
+    raw = b"\x00" in data
+    periods = [] if raw else list(stats_periods(data.decode("latin-1").splitlines(), args.period))
+    if periods:
+        for start, length, r in periods:
+            points += period_points(start, length, r)
+        end = periods[-1][0] + periods[-1][1]
+        reports = [r for _, _, r in periods]
+        mah = sum(r["a"]["avg"] * length for _, length, r in periods) / 3600000
+        summary = {"reports": len(reports), "peak": max(r["a"]["max"] for r in reports), "mah": round(mah, 2)}
+    else:
+        last = None
+        for t, mA, mV in raw_samples(data, args.rate):
+            if (mA, mV) != last:
+                points.append((t, mA, mV))
+                last = (mA, mV)
+            end = t + args.rate
+        if points:
+            t0 = points[0][0]
+            points = [(t - t0, mA, mV) for t, mA, mV in points]
+            end -= t0
+            mah = sum(mA * (b[0] - t) for (t, mA, _), b in zip(points, points[1:] + [(end,)])) / 3600000
+            summary = {"samples": end // args.rate, "peak": max(p[1] for p in points), "mah": round(mah, 2)}
+    if not points:
+        sys.exit("no stats reports or raw frames in %s" % args.log)
+
+    with open(os.path.join(args.out, "trace.csv"), "w") as f:
+        f.write("# t_us,mA,mV rebuilt from %s\n" % args.log)
+        f.write("0,%.2f,%.0f\n" % (points[0][1], points[0][2]))
+        for t, mA, mV in points:
+            f.write("%d,%.2f,%.0f\n" % ((BOOT_MS + t) * 1000, mA, mV))
+    return len(points), end, summary
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("log")
+    p.add_argument("out")
+    p.add_argument("--rate", type=int, default=1, help="ms per raw sample, the A: stream rate (default 1)")
+    p.add_argument("--period", type=int, default=1000, help="ms per report when the log has no time field (default 1000)")
+    p.add_argument("--commands", default="", help="sent after setup, e.g. \"E:1;W:800\"")
+    p.add_argument("--screens", type=int, default=0, metavar="S", help="save the display every S seconds")
+    p.add_argument("--program", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", ".pio", "build", "native", "program"))
+    args = p.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    n, length, summary = build_trace(args)
+    seconds = (BOOT_MS + length + 999) // 1000
+    cmd = [args.program, str(seconds), args.commands, os.path.join(args.out, "trace.csv")]
+    if args.screens:
+        os.makedirs(os.path.join(args.out, "screens"), exist_ok=True)
+        cmd += [os.path.join(args.out, "screens", "%06u.png"), str(args.screens)]
+    else:
+        cmd += [os.path.join(args.out, "frame.png")]
+    run = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if run.returncode:
+        sys.exit("%s failed: %s" % (args.program, run.stderr.decode(errors="replace").strip()))
+
+    out = run.stdout
+    with open(os.path.join(args.out, "serial.log"), "wb") as f:
+        f.write(out)
+    reports, events = [], []
+    for line in out.decode("latin-1").splitlines():
+        try:
+            r = json.loads(line)
+        except ValueError:
+            continue
+        if isinstance(r, dict) and "event" in r:
+            events.append(line)
+        elif isinstance(r, dict) and "a" in r:
+            reports.append(r)
+    with open(os.path.join(args.out, "reports.jsonl"), "w") as f:
+        f.writelines(json.dumps(r) + "\n" for r in reports)
+    with open(os.path.join(args.out, "events.jsonl"), "w") as f:
+        f.writelines(e + "\n" for e in events)
+
+    replay = {"reports": len(reports), "events": len(events)}
+    if reports:
+        replay["peak"] = max(r["a"]["max"] for r in reports)
+        if "mah" in reports[-1]:
+            replay["mah"] = reports[-1]["mah"]
+    print(json.dumps({"log": summary, "replay": replay, "trace_points": n, "seconds": seconds}))
+
+
+if __name__ == "__main__":
+    main()
@@ -5,7 +5,7 @@
   Aviaible at https://friedcircuits.us and docs at https://learn.friedcircuits.us
 
   @author William Garrido
-  @version 2.20
+  @version 2.40
   Created: 01/10/2013
 
   Changelog by Edouard Lafargue
@@ -113,21 +113,69 @@
   -Allow faster serial rate
   -2017-03-05 - Fixed mAh,mWh calculations
   -2017-03-13 - Optimize mAh,mWh calc/var clean up   /    TODO: Handle negative current for monitoring battery charging. 
+
+  2026-10-17
+  -Added binary framed output (COBS + CRC16) selected with O:1, integer fields for high rate logging. JSON stays default for the Java app
+  -Added raw sample streaming with A:1, every sample from the ISR delta encoded into packet sized frames
+  -Serial output goes through a non-blocking TX buffer, a host that stops reading no longer stalls the loop. T: reports drops
+  -TX buffer sends packet sized chunks, partial packets wait up to 5ms unless a reply or event is queued
+  -JSON report built from a PROGMEM template with integer fixed point values, mAh/mWh in the report are now current instead of from the last display refresh
+  -F: subscription, field mask for the stats report and rates for stats, events, telemetry and raw samples. D+/D- are only read when needed
+  -Command parser works per byte with a bounded buffer, ';' separates commands, X? reads any setting back, errors get a JSON reply
+  -Capture buffer armed with K:1, X: dumps it or the graph history as CRC checked chunks in the background
+  -Y: clock sync with the host, "ts" (opt-in with F:) gives stats and events in the host timebase
+  -Per class message sequence numbers, "seq" (opt-in with F:) in stats and events, counters in T:
+  -BENCH build (pio run -e bench) reads commands from GPIOR1, for the simavr cycle benchmark in bench/
+  -rpSamples is 32 bit, report periods over 65s (R:65535) or stats off no longer wrap it. Times are uint32_t so the run time stays right past 24.8 days
+  -mAh/mWh on the display come from the same integer totals as the report, report totals are 64 bit before scaling so mWh no longer wraps at 4295Wh
+  -Parser hardened with the libFuzzer harness in fuzz/ (pio run -e fuzz): -2147483648 argument, X: offset+length overflow, S:/C:1/button while a message shows, saved screen and warn checked on load, K: stops a capture dump
+  -M: reports free SRAM, the least free since boot from stack painting (lib/MemProbe) and the size of the globals. ram in the stats report is in every build now (opt-in, F:), pio run -t memreport breaks flash and SRAM down per subsystem
+  -Profiling zones (lib/Profile, pio run -e profile) count CPU cycles of the ISR, loop, drain, USB writes, stats, format, commands and each screen, H? dumps min/avg/max per zone. Replaces the DEBUG scope pins
+  -loop() is a cooperative scheduler (lib/Scheduler): button, rx, events, stats, tx, drain, eeprom and render tasks with a period, deadline and priority. The display is drawn one page per pass, C:2 writes EEPROM a byte at a time, L? reports runtime and missed deadlines per task. The first stats report covers a full period instead of coming right after the splash
+  -Idle sleep (SLEEP_MODE_IDLE) when no task has work left, the next interrupt (sample, USB, TWI) wakes it. I? reports the idle share and Vcc, D+ and D- peak to peak, I:0 keeps the CPU awake to compare
+  -Button on a pin change interrupt (lib/EdgeButton) replaces ClickButton polling, edges are timestamped in the ISR and decoded into clicks by the button task so a long frame can't delay or lose a click
+  -Fast boot: the INA219 and Timer1 start first thing in setup(), before the EEPROM load and the splash. The splash no longer blocks for 1.7s, the render task leaves it up while the graph fills behind it, and with FEATURE_FRAMES the capture buffer is armed from reset so K? / X:1 give the first 256ms after plug-in (not in the default image)
+  -Inrush capture, N:1 arms on the bus voltage rising past a threshold (default 4V) and samples the next 20ms (up to 1s) every 100us from the current register alone with 9 bit shunt only conversions. Peak, time to peak, time to settle and charge go out as an inrush event and on the new inrush screen (S:7, the message screen is now 7). INA219::setSpeed() and getCurrentFast_mA() are the fast paths
+  -Optional features behind build flags, all of them no longer fit the Leonardo. The default image has the JSON report,
+   subscriptions, commands and the scheduler, FEATURE_FRAMES, FEATURE_INRUSH, FEATURE_DIAG and FEATURE_SYNC add the rest.
+   Fonts are the ASCII only (r) versions, nothing else was ever drawn
+  -Strings back in flash with F(), the 2.3 change left too little SRAM for the stack. Raw sample ring is 32 samples
 */
 
 #include <Wire.h>
 #include <SPI.h>
+#include <avr/sleep.h>
 #include "INA219.h"
 #include "U8glib.h"
 #include "TimerOne.h"
-#include "ClickButton.h"
+#include "EdgeButton.h"
 #include "EEPROMex.h"
+#ifdef FEATURE_FRAMES
+#include "Frame.h"
+#endif
+#include "TxBuffer.h"
+#include "MemProbe.h"
+#include "Profile.h"
+#include "Scheduler.h"
+#include "USBTester.h"
+
+/**
+ * Optional features, set in build_flags. Together they no longer fit the 28672 bytes of
+ * flash next to the bootloader, [env:native] builds all of them for the tests
+ * FEATURE_FRAMES binary frames (O:), raw samples (A:), capture buffer (K:) and dumps (X:)
+ * FEATURE_INRUSH inrush capture (N:) and its screen
+ * FEATURE_DIAG   telemetry (T:), task stats (L:), idle share and noise in I:
+ * FEATURE_SYNC   host clock sync (Y:) and the "ts" fields
+*/
+#if defined(FEATURE_FRAMES) || defined(FEATURE_INRUSH)
+#define               FEATURE_CAPTURE //Both fill capture_Mem
+#endif
 
 /**
  * Firmware version
  * displayed on splach and serial with V: command
 */
-#define               FW_VERSION 2.32
+#define               FW_VERSION 2.40
 
 // All hardware pin usage is defined here:
 const byte            LEDPIN = 13;
@@ -141,25 +189,14 @@ const byte            USB_DM = A0;
 // inspired by the the _BV() macro
 #define               setpin(port, pin) (port) |= (1 << (pin)) 
 #define               clearpin(port, pin) (port) &= ~(1 << (pin))
-#define               DEBUGSTART1 setpin(PORTD, 5)
-#define               DEBUGEND1  clearpin(PORTD, 5)
-#define               DEBUGSTART2 setpin(PORTD, 6)
-#define               DEBUGEND2  clearpin(PORTD, 6)
 #define               SETLED  setpin(PORTC, 7)
 #define               CLEARLED clearpin(PORTC, 7)
-//#define DEBUG 1
 
 //Vars for handling alerts and events via LED and serial
 int16_t               ledWarn = 400; //Default threshold in mA
 int16_t               aPercentChange = 100; //Default percent change of current for event trigger
 bool                  eventFlag = false; //Flag for tracking if event has been triggered
-long                  eventTime = 0; //Time in millis event was triggered
-//Set event type we are triggering on or false if no events
-enum eventT {
-  DISABLED = 0,
-  WARN = 1, //based on set mA threshhold
-  PERCENT = 2 //based on percent changed
-};
+uint32_t              eventTime = 0; //Time in millis event was triggered
 eventT                  eventType = DISABLED; //Set event type, threshold, percent changed, or disabled(default)
 enum eventData {
   NONE = 0, //No recent event
@@ -188,27 +225,78 @@ uint16_t              autoscale_max_reading = 0;  // The memorized maximum readi
 uint8_t               autoscale_countdown = GRAPH_MEMORY;
 
 //Uptime tracking
-long int              uptimeOldMills = 0;
+uint32_t              uptimeOldMills = 0;
 #define               TIMEALL 1 //display time on all available screens. (where space allows)
 #define               TIMEENERGY 1 //Display time only on the energy screen.
 uint8_t               timeX = 0;
 uint8_t               timeY = 7;
 
 
-//Button
-ClickButton           modeBtn(BTN_PIN, HIGH);
-
-// Serial input buffer
-#define               INPUT_BUFFER_SIZE 16
+// Serial input buffer, one command at a time, commands end with ';' or newline, INPUT_BUFFER_SIZE in USBTester.h
+#define               INPUT_PER_LOOP 16 //Bytes parsed per loop so a burst of commands can't stall the display
 char                  input_Buffer[INPUT_BUFFER_SIZE];
 uint8_t               input_Buffer_Index;
+bool                  input_Overflow = false; //Command too long, skip to the next separator
 
 // Serial output management
-unsigned long         lastOutput = 0;
+uint32_t              lastOutput = 0;
 uint16_t              serialOutputRate = 1000;
+//Output format, JSON for the Java app or binary frames (see Frame.h)
+outputT               outputFormat = OUT_JSON;
+#ifdef FEATURE_FRAMES
+Frame                 frame;
+uint8_t               frameSeq[FRAME_TYPES]; //Sequence number per frame type
+bool                  replyFramed = false; //Current command reply goes into a FRAME_TEXT frame
+#endif
+//All serial output is queued here and drained when USB has room
+TxBuffer              tx(Serial);
+uint16_t              statsCoalesced = 0; //Stats reports merged into the next one because TX was full
+
+// Subscription, set with F: so a host only gets (and we only compute) what it needs
+// Field groups of the stats report, JSON and binary
+#define               FIELD_A      0x01 //"a" current max, min, avg
+#define               FIELD_V      0x02 //"v" voltage max, min, avg
+#define               FIELD_MAH    0x04
+#define               FIELD_MWH    0x08
+#define               FIELD_SHUNT  0x10
+#define               FIELD_DPDM   0x20 //"dp" and "dm", needs readVcc and two analogReads
+#define               FIELD_TIME   0x40
+#define               FIELD_RAM    0x80 //"ram" free SRAM now, see M: for the low-water mark
+#define               FIELD_SEQ    0x0100 //"seq" per class message number, gaps are lost messages
+#define               FIELD_TS     0x0200 //"ts" host aligned time, see Y:
+#define               FIELD_DEFAULT 0x007F //Same report as before subscriptions, new fields (and ram, DEBUG only before) are opt-in
+#ifdef FEATURE_SYNC
+#define               FIELD_ALL    0x03FF
+#else
+#define               FIELD_ALL    0x01FF //F: drops the bits of fields this build can't send
+#endif
+uint16_t              subFields = FIELD_DEFAULT;
+uint16_t              eventRate = 0; //Minimum ms between percent events, 0 no limit
+uint32_t              lastEvent = 0;
+uint16_t              telemRate = 0; //ms between unsolicited telemetry reports, 0 off
+uint32_t              lastTelem = 0;
+uint8_t               rawRate = 1; //Stream every Nth sample (ms at 1kHz)
+
+#ifdef FEATURE_SYNC
+// Host clock sync, Y:. The host estimates offset and drift from pings (NTP style) and
+// tells us which host time matches one of our timestamps, "ts" fields then follow the host clock
+uint32_t              clock_Last = 0; //micros() at the last deviceMicros() call
+uint64_t              clock_Micros = 0; //micros() extended to 64 bit, never wraps
+uint64_t              sync_DevRef = 0; //Device us at the reference point
+uint64_t              sync_HostRef = 0; //Host us at the reference point
+int32_t               sync_Drift = 0; //ppm the host clock runs faster than ours
+#define               SYNC_DRIFT_MAX 100000 //ppm, far past any crystal, keeps elapsed * sync_Drift in 64 bit
+uint32_t              input_Time = 0; //micros() when the current command was received
+#endif
 
 // On-screen output
-unsigned long         lastDisplay = 0;
+uint32_t              lastDisplay = 0;
+bool                  render_Busy = false; //Frame started, pages left to draw
+uint8_t               render_Screen = 0; //Screen of the frame being drawn
+uint32_t              render_Now = 0; //millis the frame shows
+#define               SPLASH_TIME 1700 //ms the splash stays up, sampling runs behind it
+bool                  splash_On = true;
+uint32_t              splash_Start = 0;
 
 //Current Sensor
 INA219                ina219;
@@ -235,8 +323,8 @@ volatile uint64_t     milliamphours_ACC = 0;
 float                 loadvoltage_OUT = 0; //Human readable versions for output
 float                 voltageAtPeakPower_OUT = 0;
 //USB data lines:
-volatile float        dpVoltage = 0;
-volatile float        dmVoltage = 0;
+volatile uint16_t     dpVoltage = 0; //mV
+volatile uint16_t     dmVoltage = 0; //mV
 
 // Keep track of peak/min significant values:
 volatile uint16_t     peakCurrent = 0;
@@ -253,28 +341,129 @@ volatile uint16_t     rpMinCurrent = 0;
 volatile uint16_t     rpPeakLoadVolt = 0;
 volatile uint16_t     rpMinLoadVolt = 0;
 float                 rpAvgCurrent = 0;
-float                 rpAvgLoadVolt = 0;
 volatile uint64_t     currentmA_ACC = 0;
 
 //I think this can be smaller since max is 26V vs 3200mA for current
 volatile uint64_t     loadvoltage_ACC = 0; 
-//variable size limits num samples per serial output/reset depending on sample speed currentl 200Hz
-volatile uint16_t     rpSamples = 1; 
+//Samples in the report period, 32 bit so R:65535 or stats off (F:x,0) can't wrap it at 1kHz
+volatile uint32_t     rpSamples = 1; 
+
+#ifdef FEATURE_FRAMES
+// Raw sample streaming, ring buffer filled by readADCs() and drained by rawOutput()
+// At 1kHz 32 samples gives the main loop 32ms to come back around, a pass is one display page at most
+#define               RAW_MEMORY 32 //Power of 2, 5 bytes of SRAM each
+//Payload that keeps an encoded FRAME_RAW inside one 64 byte USB packet (header, CRC, COBS byte, delimiter)
+#define               RAW_FRAME_PAYLOAD (64 - FRAME_HEADER_SIZE - FRAME_CRC_SIZE - 2)
+//Wait for this many samples (two thirds of a packet at 2 bytes per sample) or RAW_MAX_WAIT ms before sending,
+//leaves half the ring for the time the USB is busy
+#define               RAW_BATCH 16
+#define               RAW_MAX_WAIT 20
+uint32_t              lastRawOutput = 0;
+bool                  rawStream = false;
+volatile uint16_t     raw_Current[RAW_MEMORY];
+volatile uint16_t     raw_Volt[RAW_MEMORY];
+volatile uint8_t      raw_Seq[RAW_MEMORY]; //Low byte of sample number so drops can be located
+volatile uint8_t      raw_head = 0; //Written by ISR only
+volatile uint8_t      raw_tail = 0; //Written by main loop only
+volatile uint8_t      raw_nextSeq = 0;
+volatile uint32_t     raw_dropped = 0;
+uint32_t              raw_seq = 0; //Full sample number of raw_tail, kept by main loop
+uint8_t               raw_div = 0; //Samples since last queued one, ISR only
+#endif
+
+#ifdef FEATURE_CAPTURE
+// Capture buffer, mA of consecutive samples stored by readADCs() once armed with K:1, CAPTURE_MEMORY in USBTester.h
+volatile uint16_t     capture_Mem[CAPTURE_MEMORY];
+volatile uint16_t     capture_Count = 0;
+volatile bool         capture_Armed = false;
+#endif
+
+#ifdef FEATURE_INRUSH
+// Inrush capture, N:. While armed the INA219 runs 9 bit conversions and readArmed() polls the bus
+// between the normal samples. Once the bus has been below inrush_Threshold, a rise past it switches
+// to shunt only conversions and readInrush() reads the current register every INRUSH_PERIOD us
+// for inrush_Window ms. capture_Mem gets the max of every inrush_Stride samples
+#define               INRUSH_PERIOD 100 //us, an 84us conversion and a 2 byte read
+#define               INRUSH_PER_SAMPLE (uint8_t)(READFREQ / INRUSH_PERIOD) //Fast samples per normal one
+#define               INRUSH_ARMED_PERIOD 200 //us, bus polls while armed, 168us conversions
+#define               INRUSH_ARMED_PER_SAMPLE (uint8_t)(READFREQ / INRUSH_ARMED_PERIOD)
+#define               INRUSH_BAND 10 //mA, settled within 10% of the final current or this
+//START and STOP are asked for by N:, readADCs() switches the INA219 and Timer1 over
+enum inrushT { INRUSH_OFF = 0, INRUSH_STOP = 1, INRUSH_START = 2, INRUSH_WAIT = 3, INRUSH_ARMED = 4,
+               INRUSH_CAPTURE = 5, INRUSH_DONE = 6 };
+volatile inrushT      inrush_State = INRUSH_OFF; //WAIT for the bus to go below the threshold, ARMED for the rise
+volatile uint8_t      inrush_Div = 0; //readArmed() ticks since the last normal sample
+bool                  inrush_On = false; //Rearms after each capture
+uint16_t              inrush_Threshold = 4000; //mV
+uint16_t              inrush_Window = 20; //ms
+uint16_t              inrush_Total = 200; //Samples in the window
+uint8_t               inrush_Stride = 1; //Samples per capture_Mem value
+volatile uint16_t     inrush_Samples = 0;
+volatile uint16_t     inrush_Bin = 0; //capture_Mem index being filled
+volatile uint8_t      inrush_BinLeft = 0; //Samples left for it
+volatile uint16_t     inrush_MsSum = 0; //mA sum of the normal sample being built
+volatile uint8_t      inrush_MsLeft = 0;
+volatile uint32_t     inrush_Sum = 0; //mA sum over the window
+volatile uint16_t     inrush_Peak = 0;
+volatile uint16_t     inrush_PeakAt = 0; //Sample number of the peak
+volatile uint16_t     inrush_Skipped = 0; //Ticks that came while a read was still running
+volatile bool         inrush_Busy = false;
+uint16_t              inrush_Final = 0; //mA at the end of the window
+uint32_t              inrush_Settle = 0; //us until the current stays in the band around inrush_Final
+uint32_t              inrush_Charge = 0; //uC over the window
+uint16_t              inrush_Count = 0; //Captures since boot
+#endif
+
+#ifdef FEATURE_FRAMES
+// Buffer dump started with X:, sent a few chunks per loop so sampling and display keep going
+#define               DUMP_HISTORY 0 //graph_Mem_ORG, ring order so offsets stay valid when resuming
+#define               DUMP_CAPTURE 1 //capture_Mem
+//Values per FRAME_DUMP, keeps the encoded frame inside one 64 byte USB packet
+#define               DUMP_CHUNK ((RAW_FRAME_PAYLOAD - 3) / 2)
+uint8_t               dump_Buf = 0;
+uint16_t              dump_Offset = 0; //Next value to send
+uint16_t              dump_End = 0;
+#endif
+
+#ifdef PROFILE
+// Profile dump started with H?, one zone per reply while the TX buffer has room
+uint8_t               prof_Next = PROF_ZONES; //Next zone to send, PROF_ZONES when idle
+bool                  prof_Reset = false; //Clear the table once the dump is out (H:1)
+#endif
+
+#ifdef FEATURE_DIAG
+// Task stats dump started with L?, like the profile dump
+uint8_t               sched_Next = 0xFF; //Next task to send, past the last when idle
+bool                  sched_Reset = false;
+#endif
+
+// Idle sleep between passes with nothing to do, I:. Idle time and the spread of the
+// Vcc and D+/D- readings since the last I? show what it saves in self-heating and noise
+#ifdef BENCH
+bool                  idleSleep = false; //Cycles asleep would count as loop time under simavr
+#else
+bool                  idleSleep = true;
+#endif
+#ifdef FEATURE_DIAG
+uint32_t              idle_Start = 0; //millis of the I? window start
+uint32_t              idle_Ms = 0; //Time asleep in the window
+uint16_t              idle_Us = 0; //Under a ms, carried into idle_Ms
+int16_t               noise_Min[3]; //Vcc, D+, D- mV, lowest and highest since the last I?
+int16_t               noise_Max[3];
+#endif
 
 // Global defines for polling frequency
 // in microseconds
 #define READFREQ     (1000.0) 
 
-// Multiple screen support
+// Multiple screen support, MAX_SCREENS in USBTester.h
 uint8_t               current_screen = 0;
-const byte            MAX_SCREENS = 6;
 
 //Display message handling
 unsigned int          setDisplayTime = 0;
 char                  setMsgDisplay[10];
 uint8_t               oldScreen = 0;
 bool                  msgDisplay = false;
-const byte            MSGSCREEN = 6;
 
 //Track message display time, made global instead of static so that it is not updated during picture loop
 uint8_t               msgTime = 0;
@@ -290,6 +479,7 @@ const int             memBase = 32;
 const int             maxAllowedWrites = 20;
 bool                  eOK = true;
 int                   configAdress=0;
+uint8_t               config_Next = 0xFF; //Next byte of savedConfig taskEEPROM() writes, past the end when saved
 //Flag so we know we didn't load saved config on boot so we can still save new values.
 bool                  skipLoadConfig = false; 
 // Example settings structure
@@ -307,26 +497,85 @@ struct StoreStruct {
 
 // Function declarations
 void readADCs();
+void sampleUpdate();
+void readArmed();
+void inrushTrigger(uint16_t bus);
+void readInrush();
+void inrushStart();
+void inrushEnd();
+void inrushReport(uint32_t now);
+void sendInrush(uint32_t time);
+void readInput(char c);
 void processInput();
+uint8_t argValues(int32_t *vals, uint8_t max);
+void printError(Print &out, const __FlashStringHelper *err, char cmd);
 void drawBottomLine();
-void drawScope(long now);
-void drawEnergy(long now);
-void drawPeakMins(long now);
+void drawScope(uint32_t now);
+void drawEnergy(uint32_t now);
+void drawPeakMins(uint32_t now);
+void drawInrush(uint32_t now);
 void drawBig(float val, char* unit, uint8_t decimals);
+void drawScale(float val, float limit, uint8_t last, float max, char* unit);
 void setMsg(char* msg, uint16_t time);
+void setScreen(uint8_t screen);
 void drawMsg();
 void drawGraph(uint16_t reading);
-void serialOutput(long now);
+bool serialOutput(uint32_t now);
 void printJustified(uint16_t val);
 void printJustified2(float val, uint8_t dec);
 void setButtonMode(int8_t btnClicks);
-void updateTime(long now, uint8_t page);
+void updateTime(uint32_t now, uint8_t page);
 void sendEvent (int16_t threshhold);
+void serialOutputFrame(uint32_t now);
+void printTelemetry(Print &out);
+uint64_t deviceMicros();
+uint64_t hostMicros(uint64_t dev);
+void printHostTime(Print &out, uint64_t us);
+void printFixed(Print &out, uint32_t value, uint8_t decimals);
+void printTemplate(Print &out, PGM_P tpl, const uint32_t *values, uint16_t groups);
+void rawOutput();
+void dumpOutput();
+void profOutput();
+void schedOutput();
+void idle();
+void noiseReset();
+bool taskButton(uint32_t now);
+bool taskRx(uint32_t now);
+bool taskEvents(uint32_t now);
+bool taskStats(uint32_t now);
+bool taskTx(uint32_t now);
+bool taskDrain(uint32_t now);
+bool taskEEPROM(uint32_t now);
+bool taskRender(uint32_t now);
+uint16_t dumpSize(int32_t buf);
+Print& beginReply(txClass cls = TX_REPLY);
+void endReply();
+uint64_t energy_uAh();
+uint64_t energy_uWh();
+void periodSums(uint32_t &samples, uint64_t &mASum, uint64_t &mVSum);
 void saveConfig();
 bool loadConfig();
 uint8_t mapS(uint16_t x);
 long readVcc();
 
+// Loop tasks, see lib/Scheduler. Rates set by commands (R:, F:, the refresh speed)
+// are kept by the tasks themselves, period here is how often they look
+const char taskNames[][7] PROGMEM = {"button", "rx", "events", "stats", "tx", "drain", "eeprom", "render"};
+const schedTask tasks[] PROGMEM = {
+  //name, run, period ms, deadline ms, priority
+  {taskNames[0], taskButton, 5, 10, 0},
+  {taskNames[1], taskRx, 0, 10, 1},
+  {taskNames[2], taskEvents, 0, 5, 2},
+  {taskNames[3], taskStats, 0, 10, 3},
+  {taskNames[4], taskTx, 0, 20, 4},
+  {taskNames[5], taskDrain, 0, 5, 5},
+  {taskNames[6], taskEEPROM, 4, 100, 6},
+  {taskNames[7], taskRender, 0, 100, 7},
+};
+#define               TASKS (sizeof(tasks) / sizeof(tasks[0]))
+schedStats            sched_Stats[TASKS];
+Scheduler             sched(tasks, sched_Stats, TASKS);
+
 /**
   * Initialisation of pins, serial, display, and EEPROM. Also start timer to read INA219
 
@@ -338,12 +587,53 @@ void setup()
   pinMode(LEDPIN, OUTPUT);
   //digitalWrite(LEDPIN, HIGH);
   SETLED; //MACRO
-  Serial.begin(115200);
 
-  //Setup button times
-  modeBtn.debounceTime   = 20;   // Debounce timer in ms
-  modeBtn.multiclickTime = 250;  // Time limit for multi clicks
-  modeBtn.longClickTime  = 2000; // time until "held-down clicks" register
+  //Sampling starts first so the inrush and enumeration after plug-in are measured
+  // Initialize ring buffer
+  for (uint8_t i=0; i < GRAPH_MEMORY; i++) {
+    graph_Mem[i] = 54;
+  }
+  
+  //Init current sensor - Set high speed clock - saves 1.2ms sameple time
+  ina219.begin();
+  Wire.setClock(800000L);
+
+  //Speed up ADC - http://www.microsmart.co.za/technical/2014/03/01/advanced-arduino-adc/
+  //pinMode(USB_DP, INPUT);
+  //pinMode(USB_DM, INPUT);
+  ADCSRA &= ~((1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0));  // remove bits set by Arduino library
+  ADCSRA |=  ((1 << ADPS2) | (1 << ADPS1));    // set our own prescaler to 64 - 250khz ADC clock
+
+#ifdef PROFILE
+  profInit();
+#endif
+
+  //First report period starts empty and its report comes after a full period of samples,
+  //later periods start with the last sample of the one before
+  rpPeakCurrent = 0;
+  rpMinCurrent = 0xFFFF;
+  rpPeakLoadVolt = 0;
+  rpMinLoadVolt = 0xFFFF;
+  currentmA_ACC = 0;
+  loadvoltage_ACC = 0;
+  rpSamples = 0;
+  lastOutput = millis();
+
+#ifdef FEATURE_FRAMES
+  //Capture buffer holds the first CAPTURE_MEMORY mA samples from boot until K:1 rearms it. Only with
+  //FEATURE_FRAMES, the default image has no buffer to spare and no K:/X: to read it, boot inrush is not kept
+  capture_Count = 0;
+  capture_Armed = true;
+#endif
+
+  //The first conversion after the config write takes 1.06ms (12 bit shunt and bus), a sample before it reads zeros
+  delay(2);
+
+  //Start timer for reading INA219
+  Timer1.initialize(READFREQ); // 100ms reading interval
+  Timer1.attachInterrupt(readADCs); 
+
+  Serial.begin(115200);
 
   //EEPROM Init
   EEPROM.setMemPool(memBase, EEPROMSizeATmega32u4);
@@ -352,8 +642,8 @@ void setup()
   if(!(PINB & (1<<PB6))){
     eOK = loadConfig();
     if(eOK){
-      current_screen = savedConfig.screenMode;
-      ledWarn = savedConfig.warn;
+      setScreen(savedConfig.screenMode);
+      ledWarn = constrain(savedConfig.warn, 0, 3000);
       aPercentChange = savedConfig.percent;  
     } else {
       //Might be first time with EEPROM code so save default values
@@ -366,44 +656,33 @@ void setup()
   } else {skipLoadConfig = true;}
 
   //Setup display and show splash
-  display.setFont(u8g_font_6x12);
+  display.setFont(u8g_font_6x12r);
   display.setColorIndex(1);
 
   display.firstPage();
   do {
-   display.drawStr( 2, 10, "USB Tester 2.0");
-   display.drawStr( 5, 20, "FriedCircuits.us");
-   display.drawStr( 2, 60, "FW: ");
+   display.drawStrP(2, 10, U8G_PSTR("USB Tester 2.0"));
+   display.drawStrP(5, 20, U8G_PSTR("FriedCircuits.us"));
+   display.drawStrP(2, 60, U8G_PSTR("FW: "));
    display.setPrintPos(19,60);
    display.print(FW_VERSION);
    if(skipLoadConfig){
     display.setPrintPos(120,60);
-    display.print("*");
+    display.print(F("*"));
    }
   }while( display.nextPage());
-  delay(1700);
-
-  // Initialize ring buffer
-  for (uint8_t i=0; i < GRAPH_MEMORY; i++) {
-    graph_Mem[i] = 54;
-  }
-  
-  //Init current sensor - Set high speed clock - saves 1.2ms sameple time
-  ina219.begin();
-  Wire.setClock(800000L);
+  //No delay, the render task leaves the splash up for SPLASH_TIME
+  splash_On = true;
+  splash_Start = millis();
 
-  //Speed up ADC - http://www.microsmart.co.za/technical/2014/03/01/advanced-arduino-adc/
-  //pinMode(USB_DP, INPUT);
-  //pinMode(USB_DM, INPUT);
-  ADCSRA &= ~((1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0));  // remove bits set by Arduino library
-  ADCSRA |=  ((1 << ADPS2) | (1 << ADPS1));    // set our own prescaler to 64 - 250khz ADC clock
-  
   //digitalWrite(LEDPIN, LOW);
   CLEARLED; //MACRO
 
-  //Start timer for reading INA219
-  Timer1.initialize(READFREQ); // 100ms reading interval
-  Timer1.attachInterrupt(readADCs); 
+  btnBegin(BTN_PIN, HIGH); //Pressed reads high
+#ifdef FEATURE_DIAG
+  noiseReset();
+#endif
+  sched.begin();
 }
 
 /**
@@ -415,10 +694,7 @@ void setup()
  */
 void readADCs() {
   // Sample takes about 500-520us improved from 800us
-#ifdef DEBUG
-      DEBUGSTART1;  //Just a debug signal for my scope to check
-                    //how long it takes for the loop below to complete
-#endif
+  PROF_ISR_BEGIN(profIsr);
 
   /* re-enable interrupts since the ina219 functions need those.
      in practice, we're doing nested interrupts, gotta be careful here...*/
@@ -427,6 +703,79 @@ void readADCs() {
   busvoltage = ina219.getBusVoltage_V();
   current_mA = ina219.getCurrent_mA();
   loadvoltage = ((float)busvoltage + (shuntvoltage / 1000.0))+0.5; 
+  sampleUpdate();
+
+#ifdef FEATURE_INRUSH
+  //Arming and disarming the inrush capture, the INA219 is only touched from here
+  switch (inrush_State) {
+    case INRUSH_START:
+      ina219.setSpeed(INA219_SPEED_FAST);
+      inrush_Div = 0;
+      inrush_State = INRUSH_WAIT;
+      Timer1.attachInterrupt(readArmed, INRUSH_ARMED_PERIOD);
+      Timer1.restart();
+      break;
+    case INRUSH_STOP:
+      ina219.setSpeed(INA219_SPEED_NORMAL);
+      inrush_State = INRUSH_OFF;
+      Timer1.attachInterrupt(readADCs, READFREQ);
+      Timer1.restart();
+      break;
+    default:
+      inrushTrigger(busvoltage);
+  }
+#endif
+  PROF_ISR_END(profIsr, PROF_ISR);
+}
+
+#ifdef FEATURE_INRUSH
+/**
+ * Sampling while the inrush capture is armed, every INRUSH_ARMED_PERIOD us.
+ * Every INRUSH_ARMED_PER_SAMPLE ticks is a normal sample, the others only read
+ * the bus for the trigger
+ * 
+ * @param none
+ * @return none
+ */
+void readArmed() {
+  //Ticks during the normal sample are counted, so it stays every READFREQ
+  uint8_t div = inrush_Div + 1;
+  if (div >= INRUSH_ARMED_PER_SAMPLE) div = 0;
+  inrush_Div = div;
+  if (inrush_Busy) return;
+  inrush_Busy = true;
+  if (!div) {
+    readADCs();
+  } else {
+    sei();
+    inrushTrigger(ina219.getBusVoltage_V());
+  }
+  inrush_Busy = false;
+}
+
+/**
+ * Inrush trigger, the bus has to be seen below the threshold before a rise counts
+ * 
+ * @param uint16 bus voltage in mV
+ * @return none
+ */
+void inrushTrigger(uint16_t bus) {
+  if (inrush_State == INRUSH_WAIT) {
+    if (bus < inrush_Threshold) inrush_State = INRUSH_ARMED;
+  } else if (inrush_State == INRUSH_ARMED && bus >= inrush_Threshold) {
+    inrushStart();
+  }
+}
+#endif
+
+/**
+ * Totals, peaks, capture and raw stream for the sample in current_mA, busvoltage
+ * and loadvoltage, from readADCs() or once per READFREQ from readInrush()
+ * 
+ * @param none
+ * @return none
+ */
+void sampleUpdate() {
   /*Remove to speed up sensor read, moved calculation to display loop, here we only accumulate
     milliwatthours += (busvoltage*0.001)*current_mA*READFREQ/1e6/3600; // 1 Wh = 3600 joules
     milliamphours += current_mA*READFREQ/1e6/3600;*/
@@ -448,6 +797,28 @@ void readADCs() {
   currentmA_ACC += current_mA;
   loadvoltage_ACC += loadvoltage;
   rpSamples++;
+
+#ifdef FEATURE_FRAMES
+  if (capture_Armed) {
+    capture_Mem[capture_Count++] = current_mA;
+    if (capture_Count >= CAPTURE_MEMORY) capture_Armed = false;
+  }
+
+  //Queue every rawRate sample for raw streaming, drop the newest if main loop is behind
+  if (rawStream && ++raw_div >= rawRate) {
+    raw_div = 0;
+    uint8_t next = (raw_head+1) & (RAW_MEMORY-1);
+    if (next != raw_tail) {
+      raw_Current[raw_head] = current_mA;
+      raw_Volt[raw_head] = loadvoltage;
+      raw_Seq[raw_head] = raw_nextSeq;
+      raw_head = next;
+    } else {
+      raw_dropped++;
+    }
+    raw_nextSeq++;
+  }
+#endif
   
   // Update absolute peaks and mins
   if (current_mA > peakCurrent) {
@@ -465,135 +836,215 @@ void readADCs() {
       voltageAtPeakPower = loadvoltage;
       currentAtPeakPower = current_mA;
   }
-  
-#ifdef DEBUG
-			// Just a debug signal for my scope to check how long it takes for the loop below to complete
-      DEBUGEND1;  
-#endif
 }
 
+#ifdef FEATURE_INRUSH
+/**
+ * Inrush sample, the current register only, every INRUSH_PERIOD us while a capture runs.
+ * The bus voltage stays at the trigger sample until readADCs() takes over again
+ * 
+ * @param none
+ * @return none
+ */
+void readInrush() {
+  //A tick while the read before it is still on the bus is dropped, not nested
+  if (inrush_Busy) {
+    inrush_Skipped++;
+    return;
+  }
+  inrush_Busy = true;
+  PROF_ISR_BEGIN(profIsr);
+  sei();
+  int16_t mA = ina219.getCurrentFast_mA();
+  uint16_t a = mA > 0 ? mA : 0;
+  uint16_t n = inrush_Samples;
+  inrush_Sum += a;
+  if (a > inrush_Peak) {
+    inrush_Peak = a;
+    inrush_PeakAt = n;
+  }
+  //Max of each bin, the first sample of a bin starts it
+  if (inrush_BinLeft == inrush_Stride || a > capture_Mem[inrush_Bin]) capture_Mem[inrush_Bin] = a;
+  if (!--inrush_BinLeft) {
+    inrush_BinLeft = inrush_Stride;
+    inrush_Bin++;
+  }
+  //Totals, reports and the graph go on with the average of each READFREQ period
+  inrush_MsSum += a;
+  if (!--inrush_MsLeft) {
+    current_mA = (inrush_MsSum + INRUSH_PER_SAMPLE / 2) / INRUSH_PER_SAMPLE;
+    inrush_MsSum = 0;
+    inrush_MsLeft = INRUSH_PER_SAMPLE;
+    sampleUpdate();
+  }
+  inrush_Samples = ++n;
+  if (n >= inrush_Total) inrushEnd();
+  PROF_ISR_END(profIsr, PROF_ISR);
+  inrush_Busy = false;
+}
 
 /**
- * This is the display loop, button handler, and sends events if enabled by user
+ * Starts an inrush capture, called on the trigger sample.
+ * Takes over the capture buffer and Timer1
  * 
  * @param none
  * @return none
  */
-void loop()
-{
-  //display.firstPage();
-  modeBtn.Update();  
-  unsigned long now = millis();
-
-  // Refresh Display  
-  if (now - lastDisplay > OLED_REFRESH_SPEED){
-    long vcc = readVcc();
-    dpVoltage = (((analogRead(USB_DP) * vcc) >>10))*0.001; //shift is /1024
-    dmVoltage = (((analogRead(USB_DM) * vcc) >>10))*0.001;
-
-    //Update mAh and mWh here instead of in acquisition ISR
-    milliwatthours = ((float)milliwatthours_ACC/3.6e12) * READFREQ;
-    milliamphours  = ((float)milliamphours_ACC/3.6e9)  * READFREQ;
-    	
-    //Avg current and voltage here instead of ISR
-   	rpAvgCurrent =  (float)currentmA_ACC/rpSamples; 
-   	rpAvgLoadVolt = loadvoltage_ACC/rpSamples;
-   	
-   	//Update human readable loadvoltage
-   	loadvoltage_OUT = loadvoltage*0.001;
-   	voltageAtPeakPower_OUT = voltageAtPeakPower*0.001;
-     
-   //Refresh graph from current sensor data
-    drawGraph(current_mA);
-    //update msg outside picture loop before next display refresh
-    if(current_screen == 6){
-      if (msgTime <= setDisplayTime){
-      msgTime++;
-      }
-      else {
-        current_screen = oldScreen;
-        msgTime = 0;
-        msgDisplay=false;
-      }
-    }
-		//Update btn again in middle of loop to help with performance of btn response
-    modeBtn.Update();
-    	
-    display.firstPage();
-    	do{
-        if(enDisplay) {
-          switch (current_screen) {
-            case 0:
-              drawScope(now);
-              break;
-            case 1:
-              drawEnergy(now);
-              break;
-            case 2:
-               drawPeakMins(now);
-               break;
-            case 3:
-               drawBig((current_mA*loadvoltage_OUT)/1000, "W", 2);
-               break;
-            case 4:
-               drawBig(current_mA, "mA", 0);
-               break;
-            case 5:
-               drawBig(loadvoltage_OUT, "V", 2);
-               break;
-            //This is a special screen only called within the sketch to take over display with user message like reset, could be used for other things   
-            case 6: 
-               drawMsg();
-               break;
-            default:
-              drawScope(now);
-          }
-    drawBottomLine();
-	 } } while (display.nextPage() );
-    lastDisplay = now;
+void inrushStart() {
+  inrush_Samples = 0;
+  inrush_Bin = 0;
+  inrush_BinLeft = inrush_Stride;
+  inrush_MsSum = 0;
+  inrush_MsLeft = INRUSH_PER_SAMPLE;
+  inrush_Sum = 0;
+  inrush_Peak = 0;
+  inrush_PeakAt = 0;
+  inrush_Skipped = 0;
+  capture_Armed = false;
+  capture_Count = 0;
+  inrush_State = INRUSH_CAPTURE;
+  ina219.setSpeed(INA219_SPEED_CURRENT);
+  Timer1.attachInterrupt(readInrush, INRUSH_PERIOD);
+  Timer1.restart();
+}
+
+/**
+ * Ends an inrush capture, back to armed sampling or to full conversions at READFREQ,
+ * inrushReport() picks the results up from the main loop
+ * 
+ * @param none
+ * @return none
+ */
+void inrushEnd() {
+  if (inrush_On) {
+    ina219.setSpeed(INA219_SPEED_FAST);
+    inrush_Div = 0;
+    Timer1.attachInterrupt(readArmed, INRUSH_ARMED_PERIOD);
+  } else {
+    ina219.setSpeed(INA219_SPEED_NORMAL);
+    Timer1.attachInterrupt(readADCs, READFREQ);
   }
+  Timer1.restart();
+  capture_Count = (inrush_BinLeft == inrush_Stride) ? inrush_Bin : inrush_Bin + 1;
+  inrush_State = INRUSH_DONE;
+}
+#endif
+
 
-   //Update btn again in middle of loop to help with performance of btn response
-   modeBtn.Update();
+/**
+ * Runs the due tasks, see the task table above setup()
+ * 
+ * @param none
+ * @return none
+ */
+void loop()
+{
+  PROF_BEGIN(profLoop);
+#ifdef FEATURE_SYNC
+  deviceMicros(); //Often enough to catch every micros() wrap
+#endif
+  bool busy = sched.run();
+  PROF_END(profLoop, PROF_LOOP);
+  if (idleSleep && !busy) idle();
+}
 
-  // Output on serial port
-  if (now - lastOutput > serialOutputRate) {
-    serialOutput(now);
-    // Reset sampling period:
-    rpPeakCurrent = 0;
-    rpMinCurrent = current_mA;
-    rpPeakLoadVolt = 0;
-    rpMinLoadVolt = loadvoltage;
-    currentmA_ACC = current_mA;
-    loadvoltage_ACC = loadvoltage;
-    rpSamples = 1;
+/**
+ * Sleeps until the next interrupt, the 1kHz sample, USB (SOF every 1ms, data),
+ * TWI or a pin change. Only the CPU clock stops, timers, USB and the ADC keep
+ * going. Work an interrupt queues just before the sleep waits at most for the
+ * next sample
+ * 
+ * @param none
+ * @return none
+ */
+void idle() {
+#ifdef FEATURE_DIAG
+  uint32_t start = micros();
+#endif
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sleep_cpu();
+  sleep_disable();
+#ifdef FEATURE_DIAG
+  uint32_t us = idle_Us + (micros() - start);
+  idle_Ms += us / 1000;
+  idle_Us = us % 1000;
+#endif
+}
 
-    lastOutput = now;
+#ifdef FEATURE_DIAG
+/**
+ * Starts a new I? window for the idle share and the Vcc/D+/D- spread
+ * 
+ * @param none
+ * @return none
+ */
+void noiseReset() {
+  idle_Start = millis();
+  idle_Ms = 0;
+  idle_Us = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    noise_Min[i] = 0x7FFF;
+    noise_Max[i] = -1;
   }
+}
+#endif
 
-  // Check if we have serial input
-  while (Serial.available()) {
-    input_Buffer[input_Buffer_Index] = Serial.read();
-    if (input_Buffer[input_Buffer_Index] == '\n') {
-      input_Buffer[input_Buffer_Index] = 0;
-      processInput();
-      input_Buffer_Index = 0;
-    } else 
-      input_Buffer_Index = (input_Buffer_Index+1)%INPUT_BUFFER_SIZE;
+/**
+ * Button, decodes the edges the pin change interrupt queued (lib/EdgeButton)
+ * 
+ * @param uint32 now pass millis
+ * @return bool false, done
+ */
+bool taskButton(uint32_t /*now*/) {
+  int8_t clicks = btnUpdate();
+  if (clicks != 0) setButtonMode(clicks);
+  return false;
+}
+
+/**
+ * Serial input, at most INPUT_PER_LOOP bytes per pass
+ * 
+ * @param uint32 now pass millis
+ * @return bool true while more input is waiting
+ */
+bool taskRx(uint32_t /*now*/) {
+  for (uint8_t i = 0; i < INPUT_PER_LOOP && Serial.available(); i++) {
+    readInput(Serial.read());
+  }
+#ifdef BENCH
+  //No USB host under the simulator, bench/avrbench.c writes command bytes here
+  if (GPIOR1) {
+    readInput(GPIOR1);
+    GPIOR1 = 0;
   }
+#endif
+  return Serial.available() > 0;
+}
 
+/**
+ * Percent change events, LED and WARN events, inrush results
+ * 
+ * @param uint32 now pass millis
+ * @return bool false, done
+ */
+bool taskEvents(uint32_t now) {
+#ifdef FEATURE_INRUSH
+  if (inrush_State == INRUSH_DONE) inrushReport(now);
+#endif
   //Calculate percent changed, if above set user threshold send single event to serial
   //TODO Handle Negative perecent change
   if(eventType == PERCENT){
     float pChange = 0;
     pChange = ((current_mA - rpAvgCurrent) / (float)rpAvgCurrent) * 100.00;
-    if(pChange >= (float)aPercentChange){
+    if(pChange >= (float)aPercentChange && (!eventRate || now - lastEvent >= eventRate)){
       eventStatus = SINGLE;
       eventTime = now-uptimeOldMills;
       sendEvent(pChange);
+      lastEvent = now;
     }
   }
-  uint8_t btnState = (PINB & (1<<PB6)); //digitalRead(BTN_PIN);
+  bool btnState = btnDown();
   if ((current_mA >= ledWarn) || (btnState)){
     //digitalWrite(LEDPIN, HIGH); 
     SETLED; //MACRO
@@ -614,15 +1065,318 @@ void loop()
        eventFlag = false;
      }
   }
+  return false;
+}
+
+#ifdef FEATURE_INRUSH
+/**
+ * Results of a finished inrush capture from capture_Mem: the final current is the
+ * average of the last eighth of the window, settled is the end of the last value
+ * outside the band around it. Sent as an inrush event, the inrush screen (S:7)
+ * shows the latest one, then rearmed if N: is still on
+ * 
+ * @param uint32 now pass millis
+ * @return none
+ */
+void inrushReport(uint32_t now) {
+  uint16_t bins = capture_Count;
+  uint16_t tail = (bins / 8) ? bins / 8 : 1;
+  uint32_t sum = 0;
+  for (uint16_t i = bins - tail; i < bins; i++) sum += capture_Mem[i];
+  inrush_Final = sum / tail;
+  uint16_t band = max(inrush_Final / 10, INRUSH_BAND);
+  uint16_t last = 0;
+  for (uint16_t i = 0; i < bins; i++) {
+    if (capture_Mem[i] > inrush_Final + band || capture_Mem[i] + band < inrush_Final) last = i + 1;
+  }
+  inrush_Settle = (uint32_t)last * inrush_Stride * INRUSH_PERIOD;
+  if (inrush_Settle > (uint32_t)inrush_Total * INRUSH_PERIOD) inrush_Settle = (uint32_t)inrush_Total * INRUSH_PERIOD;
+  //mA * us is nC
+  inrush_Charge = (uint64_t)inrush_Sum * INRUSH_PERIOD / 1000;
+  inrush_Count++;
+  sendInrush(now - uptimeOldMills);
+  inrush_State = inrush_On ? INRUSH_WAIT : INRUSH_OFF;
+}
+#endif
+
+/**
+ * Stats report every serialOutputRate ms
+ * 
+ * @param uint32 now pass millis
+ * @return bool false, done
+ */
+bool taskStats(uint32_t now) {
+  if (serialOutputRate && now - lastOutput > serialOutputRate) {
+    PROF_BEGIN(profStats);
+    bool sent = serialOutput(now);
+    PROF_END(profStats, PROF_STATS);
+    if (sent) {
+      // Reset sampling period:
+      noInterrupts();
+      rpPeakCurrent = 0;
+      rpMinCurrent = current_mA;
+      rpPeakLoadVolt = 0;
+      rpMinLoadVolt = loadvoltage;
+      currentmA_ACC = current_mA;
+      loadvoltage_ACC = loadvoltage;
+      rpSamples = 1;
+      interrupts();
+    } else if (Serial && statsCoalesced != 0xFFFF) {
+      // TX is full, keep the sampling period going so the next report covers both
+      statsCoalesced++;
+    }
+    lastOutput = now;
+  }
+  return false;
+}
+
+/**
+ * Other output queued for TX: telemetry, raw samples and the background dumps
+ * 
+ * @param uint32 now pass millis
+ * @return bool false, done
+ */
+bool taskTx(uint32_t now) {
+#if !defined(FEATURE_DIAG) && !defined(FEATURE_FRAMES)
+  (void)now; //Only the optional outputs keep a rate
+#endif
+#ifdef FEATURE_DIAG
+  if (telemRate && now - lastTelem > telemRate) {
+    Print &out = beginReply(TX_TELEM);
+    printTelemetry(out);
+    endReply();
+    lastTelem = now;
+  }
+#endif
+
+#ifdef FEATURE_FRAMES
+  if (rawStream && ((((uint8_t)(raw_head - raw_tail) & (RAW_MEMORY-1)) >= RAW_BATCH) || (now - lastRawOutput > RAW_MAX_WAIT))) {
+    rawOutput();
+    lastRawOutput = now;
+  }
+
+  if (dump_Offset < dump_End) dumpOutput();
+#endif
+#ifdef FEATURE_DIAG
+  if (sched_Next < TASKS) schedOutput();
+#endif
+#ifdef PROFILE
+  if (prof_Next < PROF_ZONES) profOutput();
+#endif
+  return false;
+}
+
+/**
+ * Moves queued output into the USB endpoint, runs after the tasks that queue it
+ * 
+ * @param uint32 now pass millis
+ * @return bool false, done
+ */
+bool taskDrain(uint32_t /*now*/) {
+  tx.drain();
+  return false;
+}
+
+/**
+ * Writes a config saved with C:2, one changed byte per run once the EEPROM
+ * is ready, a write takes 3.3ms and would stall the loop otherwise
+ * 
+ * @param uint32 now pass millis
+ * @return bool true while bytes are left
+ */
+bool taskEEPROM(uint32_t /*now*/) {
+  const uint8_t *data = (const uint8_t *)&savedConfig;
+  while (config_Next < sizeof(StoreStruct)) {
+    if (!EEPROM.isReady()) return true;
+    uint8_t i = config_Next++;
+    if (EEPROM.readByte(configAdress + i) != data[i]) {
+      EEPROM.writeByte(configAdress + i, data[i]);
+      break;
+    }
+  }
+  return config_Next < sizeof(StoreStruct);
+}
+
+/**
+ * Display, a frame every OLED_REFRESH_SPEED ms drawn one page per run so
+ * the other tasks get a turn between pages
+ * 
+ * @param uint32 now pass millis
+ * @return bool true until the last page of the frame is out
+ */
+bool taskRender(uint32_t now) {
+  if (!render_Busy) {
+    if (now - lastDisplay <= OLED_REFRESH_SPEED) return false;
+    //D+/D- cost a Vcc conversion and two analogReads, only when the V screen or a subscriber shows them
+    if ((enDisplay && current_screen == 5) || (serialOutputRate && (subFields & FIELD_DPDM))) {
+      long vcc = readVcc();
+      dpVoltage = (analogRead(USB_DP) * vcc) >>10; //shift is /1024
+      dmVoltage = (analogRead(USB_DM) * vcc) >>10;
+#ifdef FEATURE_DIAG
+      int16_t mV[3] = {(int16_t)vcc, (int16_t)dpVoltage, (int16_t)dmVoltage};
+      for (uint8_t i = 0; i < 3; i++) {
+        noise_Min[i] = min(noise_Min[i], mV[i]);
+        noise_Max[i] = max(noise_Max[i], mV[i]);
+      }
+#endif
+    }
+
+    //Update mAh and mWh here instead of in acquisition ISR, same integer totals as the report
+    milliwatthours = energy_uWh() * 0.001;
+    milliamphours  = energy_uAh() * 0.001;
+    	
+    //Avg current and voltage here instead of ISR
+    uint32_t samples;
+    uint64_t mASum, mVSum;
+    periodSums(samples, mASum, mVSum);
+   	rpAvgCurrent =  (float)mASum/samples; 
+   	
+   	//Update human readable loadvoltage
+   	loadvoltage_OUT = loadvoltage*0.001;
+   	voltageAtPeakPower_OUT = voltageAtPeakPower*0.001;
+     
+   //Refresh graph from current sensor data
+    drawGraph(current_mA);
+    //update msg outside picture loop before next display refresh
+    if(current_screen == MSGSCREEN){
+      if (msgTime <= setDisplayTime){
+      msgTime++;
+      }
+      else {
+        current_screen = oldScreen;
+        msgTime = 0;
+        msgDisplay=false;
+      }
+    }
+    //The whole frame shows one screen and one time, whatever changes while it is drawn
+    render_Screen = current_screen;
+    render_Now = now;
+    lastDisplay = now;
+    //The graph keeps filling behind the splash
+    if (splash_On) {
+      if (now - splash_Start < SPLASH_TIME) return false;
+      splash_On = false;
+    }
+    render_Busy = true;
+    display.firstPage();
+  }
+
+  PROF_BEGIN(profScreen);
+  if(enDisplay) {
+    switch (render_Screen) {
+      case 0:
+        drawScope(render_Now);
+        break;
+      case 1:
+        drawEnergy(render_Now);
+        break;
+      case 2:
+         drawPeakMins(render_Now);
+         break;
+      case 3:
+         drawBig((current_mA*loadvoltage_OUT)/1000, "W", 2);
+         break;
+      case 4:
+         drawBig(current_mA, "mA", 0);
+         break;
+      case 5:
+         drawBig(loadvoltage_OUT, "V", 2);
+         break;
+#ifdef FEATURE_INRUSH
+      case 6:
+         drawInrush(render_Now);
+         break;
+#endif
+      //This is a special screen only called within the sketch to take over display with user message like reset, could be used for other things   
+      case 7: 
+         drawMsg();
+         break;
+      default:
+        drawScope(render_Now);
+    }
+    drawBottomLine();
+  }
+  render_Busy = display.nextPage();
+  PROF_END(profScreen, PROF_SCREEN + render_Screen);
+  return render_Busy;
+}
+
+/**
+ * Collects one command, called for every received byte
+ * Commands end with ';' or a newline so several can share a line,
+ * a command longer than the buffer is skipped and answered with an error
+ * 
+ * @param char c received byte
+ * @return none
+ */
+void readInput(char c) {
+  if (c == '\r') return;
+  if (c == '\n' || c == ';') {
+#ifdef FEATURE_SYNC
+    input_Time = micros();
+#endif
+    if (input_Overflow) {
+      Print &out = beginReply();
+      printError(out, F("long"), 0);
+      endReply();
+    } else if (input_Buffer_Index) {
+      input_Buffer[input_Buffer_Index] = 0;
+      PROF_BEGIN(profCmd);
+      processInput();
+      PROF_END(profCmd, PROF_CMD);
+    }
+    input_Buffer_Index = 0;
+    input_Overflow = false;
+  } else if (input_Buffer_Index < INPUT_BUFFER_SIZE-1) {
+    input_Buffer[input_Buffer_Index++] = c;
+  } else {
+    input_Overflow = true;
+  }
+}
 
-  if (modeBtn.clicks != 0) setButtonMode(modeBtn.clicks);
+/**
+ * Parses the command arguments, decimal numbers separated with ','
+ * 
+ * @param int32_t* vals set to the parsed numbers
+ * @param uint8_t max size of vals, anything after that is ignored
+ * @return uint8_t number of values parsed, 0 if any of them is not a valid number
+ */
+uint8_t argValues(int32_t *vals, uint8_t max) {
+  char *arg = &input_Buffer[2];
+  uint8_t n = 0;
+  while (n < max) {
+    char *start = arg;
+    if (*arg == '-') arg++;
+    if (*arg < '0' || *arg > '9') return 0;
+    while (*arg >= '0' && *arg <= '9') arg++;
+    if (*arg && *arg != ',') return 0;
+    //strtoul so values up to 2^32 (micros) survive, read back as uint32_t
+    //negated unsigned, -2147483648 has no positive int32_t
+    uint32_t v = strtoul(*start == '-' ? start+1 : start, NULL, 10);
+    vals[n++] = (int32_t)((*start == '-') ? 0u - v : v);
+    if (!*arg++) break;
+  }
+  return n;
+}
 
+/**
+ * Error reply, {"err":"val","c":"R"}
+ * 
+ * @param Print out reply to write to
+ * @param __FlashStringHelper* err error name in flash, F(): syntax, cmd (unknown command), val (bad or missing value), long (command too long)
+ * @param char cmd command letter, 0 for none
+ * @return none
+ */
+void printError(Print &out, const __FlashStringHelper *err, char cmd) {
+  out.print(F("{\"err\":\"")); out.print(err);
+  if (cmd) { out.print(F("\",\"c\":\"")); out.write(cmd); }
+  out.println(F("\"}"));
 }
 
 /** 
  * Here are the commands that are supported:  
  * R:XXXX where XXXX is a delay in miliseconds (any valid integer)
- * S:X    where X is screen number (starting at 1)
+ * S:X    where X is screen number (starting at 1), S? and the "s" of C:0 and C:3 use the same numbers
  * W:XXXX where XXXX is the warning threshold in mA for switching on the blue LED
  * Z:     reset counters
  * V:     return firmware version
@@ -630,99 +1384,360 @@ void loop()
  * P:XXX  Sets percent for mA changed event
  * C:X    Control config, read, load and save
  * D:X    Disable/Enable display output
+ * O:X    Output format, 0 JSON, 1 binary frames
+ * A:X    Raw sample streaming, 1 enables (and selects binary frames), 0 disables
+ * T:     Telemetry, TX drop counters
+ * F:M[,S,E,T,A] Subscription, M field mask (FIELD_*), then optional ms rates for
+ *        stats (0 off), percent events (0 no limit), telemetry (0 off) and raw samples (1 every sample, up to 255)
+ * K:X    Capture, 1 (re)arms the capture buffer, filled with the next CAPTURE_MEMORY mA samples, 0 stops
+ *        Armed from reset, so until then it holds the first CAPTURE_MEMORY ms after boot
+ * Y:H    Clock sync ping, H host time (any integer) is echoed with our receive and reply micros()
+ * Y:M,U,R[,P] Host time M ms + U us matches our receive time R of an earlier ping, P drift in ppm (up to +-SYNC_DRIFT_MAX)
+ * X:B[,O,L] Dump L (0 all) values of buffer B (0 graph history, 1 captured samples) from offset O as
+ *        FRAME_DUMP frames (selects binary), X? shows progress. Resend from the last good offset to resume
+ * M:     Memory, free SRAM now, least free since boot (stack high-water mark) and bytes used by globals
+ * I:X    Idle sleep, 1 sleeps when no task has work (default) 0 stays awake. Replies with the idle share and
+ *        Vcc, D+, D- peak to peak since the last I:, for comparing self-heating and noise between the two
+ * L:X    Tasks, L? dumps runs, avg/max runtime in us and missed deadlines per task, L:1 dumps then clears, L:0 clears
+ * N:X[,T,L] Inrush, 1 arms on the bus voltage rising past T mV (default 4000) and captures the next L ms
+ *        (default 20, up to 1000) of current every INRUSH_PERIOD us, rearming after each capture, 0 disarms.
+ *        Results come as an inrush event and on S:7, the waveform is in the capture buffer (X:1). Armed, samples are 9 bit
+ *        Replies the state s (inrushT): 0 off, 1 stop, 2 start, 3 wait, 4 armed, 5 capture, 6 done
+ * H:X    Profile (PROFILE builds), H? dumps cycles per zone as min/avg/max, H:1 dumps then clears, H:0 clears
+ * 
+ * O:, A:, K: and X: need FEATURE_FRAMES, N: FEATURE_INRUSH, T: and L: FEATURE_DIAG (I: then only has s)
+ * and Y: FEATURE_SYNC, without them they reply {"err":"cmd"}
  * 
+ * Every command that sets a value also takes X? to read it back (C? is C:3),
+ * several commands can be sent on one line separated with ';'
+ * Replies are JSON, wrapped in a FRAME_TEXT frame while in binary mode
+ * Errors reply {"err":"syntax"|"cmd"|"val"|"long"|"busy","c":"X"}
+ *
  * @param none
  * @return none
  */
  void processInput() {
-  if (input_Buffer[1] != ':')
+  char cmd = input_Buffer[0];
+  bool set = (input_Buffer[1] == ':');
+  int32_t args[5] = {0};
+  uint8_t nargs = 0;
+  Print &out = beginReply();
+  if (!set && (input_Buffer[1] != '?' || input_Buffer[2])) {
+    printError(out, F("syntax"), cmd);
+    endReply();
     return;
-  switch (input_Buffer[0]) {
+  }
+  //Commands that need a number to set, others ignore the argument
+  if (set && strchr_P(PSTR("RSWEPCDOAFKXYHLIN"), cmd) && !(nargs = argValues(args, 5))) {
+    printError(out, F("val"), cmd);
+    endReply();
+    return;
+  }
+  int32_t val = args[0];
+  switch (cmd) {
     case 'R':
-      serialOutputRate = atoi(&input_Buffer[2]);
-      if (serialOutputRate < 100) serialOutputRate = 100; // We sample at 1ms, so we need to remain above that value with time for everything else
-      Serial.print("{\"R\":"); Serial.print(serialOutputRate);Serial.println("}");
+      if (set) {
+        serialOutputRate = constrain(val, 0, 65535);
+        // We sample at 1ms, JSON needs to remain above that value with time for everything else
+        // binary frames are small enough to go out every loop
+        if (serialOutputRate < 100 && outputFormat == OUT_JSON) serialOutputRate = 100; 
+        if (serialOutputRate < 1) serialOutputRate = 1;
+      }
+      out.print(F("{\"R\":")); out.print(serialOutputRate);out.println(F("}"));
       break;
     case 'S':
-       current_screen = (input_Buffer[2]-49) % MAX_SCREENS;
-       Serial.print("{\"S\":");Serial.print(current_screen);Serial.println("}");
+       if (set) {
+         if (val < 1) { printError(out, F("val"), cmd); break; }
+         setScreen((val-1) % MAX_SCREENS);
+       }
+       out.print(F("{\"S\":"));out.print(current_screen+1);out.println(F("}"));
        break;
     case 'Z':
+       if (!set) { printError(out, F("syntax"), cmd); break; }
        setButtonMode(-1);
-       Serial.println("{\"Z\":\"OK\"}");
+       out.println(F("{\"Z\":\"OK\"}"));
        break;
     case 'W':
-       ledWarn = atoi(&input_Buffer[2]);
-       if (ledWarn > 3000) ledWarn = 3000;
-       Serial.print("{\"W\":"); Serial.print(ledWarn);Serial.println("}");
+       if (set) {
+         ledWarn = constrain(val, 0, 3000);
+       }
+       out.print(F("{\"W\":")); out.print(ledWarn);out.println(F("}"));
        break;
     case 'V':
-       Serial.print("{\"V\":"); Serial.print(FW_VERSION);Serial.println("}");
+       out.print(F("{\"V\":")); out.print(FW_VERSION);out.println(F("}"));
        break;
-    case 'E':{
-         uint8_t inputNum = (input_Buffer[2]-48);
-         if(inputNum >= 0 && inputNum <= 2){
-            eventType = (eventT)inputNum;
-            if(eventType == DISABLED){eventFlag = false;}
-         } 
-         Serial.print("{\"E\":"); Serial.print(eventType);Serial.println("}");
+    case 'E':
+       if (set) {
+         if (val < DISABLED || val > PERCENT) { printError(out, F("val"), cmd); break; }
+         eventType = (eventT)val;
+         if(eventType == DISABLED){eventFlag = false;}
        }
+       out.print(F("{\"E\":")); out.print(eventType);out.println(F("}"));
        break;
     case 'P':
-      aPercentChange = atoi(&input_Buffer[2]);
-      //if (aPercentChange > 100) aPercentChange = 100;
-      Serial.print("{\"P\":"); Serial.print(aPercentChange);Serial.println("}");
+      if (set) {
+        aPercentChange = constrain(val, -32768, 32767);
+        //if (aPercentChange > 100) aPercentChange = 100;
+      }
+      out.print(F("{\"P\":")); out.print(aPercentChange);out.println(F("}"));
       break;
     case 'C':
-      switch (input_Buffer[2]-48) {
+      switch (set ? val : 3) {
         case 0: //Output currently saved config
           if(loadConfig()){
-            Serial.print("{\"C\":");
-            Serial.print("{\"s\":"); Serial.print(savedConfig.screenMode); 
-            Serial.print(", \"w\":"); Serial.print(savedConfig.warn);  
-            Serial.print(", \"p\":"); Serial.print(savedConfig.percent);
-            Serial.print(", \"v\":"); Serial.print(savedConfig.version);
-            Serial.println("}}");
-          } else { Serial.println("Failed");}
+            out.print(F("{\"C\":"));
+            out.print(F("{\"s\":")); out.print(savedConfig.screenMode+1); 
+            out.print(F(", \"w\":")); out.print(savedConfig.warn);  
+            out.print(F(", \"p\":")); out.print(savedConfig.percent);
+            out.print(F(", \"v\":")); out.print(savedConfig.version);
+            out.println(F("}}"));
+          } else { out.println(F("Failed"));}
           break;
         case 1: //Load config from EEPROM
           if(loadConfig()){
-            current_screen = savedConfig.screenMode;
-            ledWarn = savedConfig.warn;
+            setScreen(savedConfig.screenMode);
+            ledWarn = constrain(savedConfig.warn, 0, 3000);
             aPercentChange = savedConfig.percent;  
-            Serial.println("C:OK");
-          } else { Serial.println("C:Failed");}
+            out.println(F("C:OK"));
+          } else { out.println(F("C:Failed"));}
           break;
         case 2: //Save config to EEPROM
-          savedConfig.screenMode = current_screen;
+          //The message screen is never saved, the one under it is
+          savedConfig.screenMode = msgDisplay ? oldScreen : current_screen;
           savedConfig.warn = ledWarn;
           savedConfig.percent = aPercentChange;
           saveConfig();
-          Serial.println("C:OK");
+          out.println(F("C:OK"));
           break;
         case 3: //Output running config
-          Serial.print("{\"RC\":");
-          Serial.print("{\"s\":"); Serial.print(current_screen); 
-          Serial.print(", \"w\":"); Serial.print(ledWarn);  
-          Serial.print(", \"p\":"); Serial.print(aPercentChange);
-          Serial.print(", \"v\":"); Serial.print(CONFIG_VERSION);
-          Serial.println("}}");
+          out.print(F("{\"RC\":"));
+          out.print(F("{\"s\":")); out.print(current_screen+1); 
+          out.print(F(", \"w\":")); out.print(ledWarn);  
+          out.print(F(", \"p\":")); out.print(aPercentChange);
+          out.print(F(", \"v\":")); out.print(CONFIG_VERSION);
+          out.println(F("}}"));
+          break;
         default:
+          printError(out, F("val"), cmd);
           break;
       }
       break;
     case 'D':
-      if(input_Buffer[2]-48 == 0){
-        enDisplay = false;
-        Serial.print("{\"D\":"); Serial.print(enDisplay);Serial.println("}");
-      } else { 
-          enDisplay = true; 
-          Serial.print("{\"D\":"); Serial.print(enDisplay);Serial.println("}"); 
+      if (set) {
+        enDisplay = (val != 0);
+      }
+      out.print(F("{\"D\":")); out.print(enDisplay);out.println(F("}"));
+      break;
+#ifdef FEATURE_FRAMES
+    case 'O':
+      if (!set) {
+        out.print(F("{\"O\":")); out.print(outputFormat);out.println(F("}"));
+        break;
+      }
+      if(val == OUT_BINARY){
+        outputFormat = OUT_BINARY;
+      } else {
+        outputFormat = OUT_JSON;
+        if (serialOutputRate && serialOutputRate < 100) serialOutputRate = 100;
+      }
+      out.print(F("{\"O\":")); out.print(outputFormat);out.println(F("}"));
+      //Delimit the JSON reply so the host can pick up the first frame cleanly
+      if(outputFormat == OUT_BINARY && !replyFramed) out.write((uint8_t)FRAME_DELIMITER);
+      break;
+    case 'A':
+      if (!set) {
+        out.print(F("{\"A\":")); out.print(rawStream);out.println(F("}"));
+        break;
+      }
+      if(val == 1){
+        //Start clean so the first frame has no stale samples
+        raw_tail = raw_head;
+        raw_seq = raw_nextSeq;
+        raw_div = 0;
+        outputFormat = OUT_BINARY;
+        rawStream = true;
+      } else {
+        rawStream = false;
+      }
+      out.print(F("{\"A\":")); out.print(rawStream);out.println(F("}"));
+      if(rawStream && !replyFramed) out.write((uint8_t)FRAME_DELIMITER);
+      break;
+#endif
+#ifdef FEATURE_DIAG
+    case 'T':
+      printTelemetry(out);
+      break;
+#endif
+    case 'I':{
+      if (set) idleSleep = (val != 0);
+      out.print(F("{\"I\":{\"s\":")); out.print(idleSleep);
+#ifdef FEATURE_DIAG
+      //Idle share in permille and peak to peak mV since the last I?, -1 when not measured
+      uint32_t window = millis() - idle_Start;
+      out.print(F(",\"i\":")); out.print(window ? (uint32_t)((uint64_t)idle_Ms * 1000 / window) : 0);
+      out.print(F(",\"pp\":["));
+      for (uint8_t i = 0; i < 3; i++) {
+        if (i) out.print(F(","));
+        out.print(noise_Max[i] >= noise_Min[i] ? noise_Max[i] - noise_Min[i] : -1);
+      }
+      out.print(F("]"));
+      noiseReset();
+#endif
+      out.println(F("}}"));
+      break;
+    }
+    case 'M':
+      out.print(F("{\"M\":{\"f\":")); out.print(memFree());
+      out.print(F(",\"l\":")); out.print(memLowest());
+      out.print(F(",\"s\":")); out.print(memStatic()); out.println(F("}}"));
+      break;
+#ifdef FEATURE_DIAG
+    case 'L':
+      //Same as H: for the task stats
+      if (set && !val) {
+        sched.reset();
+        sched_Next = TASKS;
+      } else {
+        sched_Next = 0;
+        sched_Reset = set;
+      }
+      out.print(F("{\"L\":{\"t\":")); out.print(set && !val ? 0 : TASKS); out.println(F("}}"));
+      break;
+#endif
+#ifdef PROFILE
+    case 'H':
+      //H:0 clears the table, H? and H:1 dump it, H:1 clears it once sent
+      if (set && !val) {
+        profReset();
+        prof_Next = PROF_ZONES;
+      } else {
+        prof_Next = 0;
+        prof_Reset = set;
+      }
+      out.print(F("{\"H\":{\"z\":")); out.print(set && !val ? 0 : PROF_ZONES);
+      out.print(F(",\"mhz\":")); out.print(F_CPU / 1000000UL); out.println(F("}}"));
+      break;
+#endif
+    case 'F':{
+      //Fields then rates, anything left out keeps its current value
+      //all or nothing, the raw sample divider is 1-255 and the others 16 bit
+      uint8_t i = 0;
+      while (i < nargs && args[i] >= (i == 4 ? 1 : 0) && args[i] <= (i == 4 ? 255 : 65535)) i++;
+      if (i < nargs) { printError(out, F("val"), cmd); break; }
+      for (i = 0; i < nargs; i++) {
+        uint16_t val = args[i];
+        switch (i) {
+          case 0: subFields = val & FIELD_ALL; break;
+          case 1:
+            serialOutputRate = val;
+            if (serialOutputRate && serialOutputRate < 100 && outputFormat == OUT_JSON) serialOutputRate = 100;
+            break;
+          case 2: eventRate = val; break;
+          case 3: telemRate = val; break;
+          case 4: rawRate = val; break;
+        }
+      }
+      out.print(F("{\"F\":{\"f\":")); out.print(subFields);
+      out.print(F(",\"r\":[")); out.print(serialOutputRate);
+      out.print(F(",")); out.print(eventRate);
+      out.print(F(",")); out.print(telemRate);
+      out.print(F(",")); out.print(rawRate);
+      out.println(F("]}}"));
+      }
+      break;
+#ifdef FEATURE_FRAMES
+    case 'K':
+      if (set) {
+#ifdef FEATURE_INRUSH
+        if (inrush_State == INRUSH_CAPTURE || inrush_State == INRUSH_DONE) { printError(out, F("busy"), cmd); break; }
+#endif
+        //Restart the capture, the ISR fills it from the next sample
+        noInterrupts();
+        capture_Count = 0;
+        capture_Armed = (val != 0);
+        interrupts();
+        //A dump of the old capture would run into the new one
+        if (dump_Buf == DUMP_CAPTURE) dump_End = dump_Offset;
+      }
+      out.print(F("{\"K\":{\"s\":")); out.print(capture_Armed);
+      out.print(F(",\"n\":")); out.print(capture_Count); out.println(F("}}"));
+      break;
+#endif
+#ifdef FEATURE_INRUSH
+    case 'N':
+      if (set) {
+        //Threshold and window can't change under a running capture
+        if (inrush_State == INRUSH_CAPTURE || inrush_State == INRUSH_DONE) { printError(out, F("busy"), cmd); break; }
+        if (nargs > 1) inrush_Threshold = constrain(args[1], 0, 26000);
+        if (nargs > 2) inrush_Window = constrain(args[2], 1, 1000);
+        inrush_On = (val != 0);
+        noInterrupts();
+        inrush_Total = inrush_Window * INRUSH_PER_SAMPLE;
+        inrush_Stride = (inrush_Total + CAPTURE_MEMORY - 1) / CAPTURE_MEMORY;
+        //Already armed it waits for the bus to go low again, else the ISR switches over
+        if (inrush_On) inrush_State = (inrush_State == INRUSH_WAIT || inrush_State == INRUSH_ARMED) ? INRUSH_WAIT : INRUSH_START;
+        else if (inrush_State != INRUSH_OFF) inrush_State = INRUSH_STOP;
+        interrupts();
+#ifdef FEATURE_FRAMES
+        //The capture takes the buffer over, an old dump would run into it
+        if (inrush_On && dump_Buf == DUMP_CAPTURE) dump_End = dump_Offset;
+#endif
+      }
+      out.print(F("{\"N\":{\"s\":")); out.print(inrush_State);
+      out.print(F(",\"t\":")); out.print(inrush_Threshold);
+      out.print(F(",\"ms\":")); out.print(inrush_Window);
+      out.print(F(",\"n\":")); out.print(inrush_Count); out.println(F("}}"));
+      break;
+#endif
+#ifdef FEATURE_FRAMES
+    case 'X':{
+      if (set) {
+        uint16_t size = dumpSize(val);
+        int32_t offset = (nargs > 1) ? args[1] : 0;
+        int32_t len = (nargs > 2) ? args[2] : 0;
+        if (!size || offset < 0 || offset >= size || len < 0) { printError(out, F("val"), cmd); break; }
+        if (!len || len > size - offset) len = size - offset;
+        dump_Buf = val;
+        dump_Offset = offset;
+        dump_End = offset + len;
+        outputFormat = OUT_BINARY;
+      }
+      out.print(F("{\"X\":{\"b\":")); out.print(dump_Buf);
+      out.print(F(",\"o\":")); out.print(dump_Offset);
+      out.print(F(",\"e\":")); out.print(dump_End);
+      //History is a ring, "i" is the index of the oldest point right now
+      if (dump_Buf == DUMP_HISTORY) { out.print(F(",\"i\":")); out.print(ring_idx); }
+      out.println(F("}}"));
+      if(set && !replyFramed) out.write((uint8_t)FRAME_DELIMITER);
+      }
+      break;
+#endif
+#ifdef FEATURE_SYNC
+    case 'Y':
+      if (set && nargs == 1) {
+        //Ping, the host works out offset and round trip from its send and receive times
+        out.print(F("{\"Y\":{\"h\":")); out.print((uint32_t)val);
+        out.print(F(",\"r\":")); out.print(input_Time);
+        out.print(F(",\"s\":")); out.print(micros()); out.println(F("}}"));
+        break;
       }
+      if (set) {
+        if (nargs < 3 || (nargs > 3 && (args[3] < -SYNC_DRIFT_MAX || args[3] > SYNC_DRIFT_MAX))) { printError(out, F("val"), cmd); break; }
+        uint64_t dev = deviceMicros();
+        //R is recent, rebuild its 64 bit value from how long ago it was
+        sync_DevRef = dev - (uint32_t)((uint32_t)dev - (uint32_t)args[2]);
+        sync_HostRef = (uint64_t)(uint32_t)val * 1000 + args[1];
+        sync_Drift = (nargs > 3) ? args[3] : 0;
+      }
+      out.print(F("{\"Y\":{\"ts\":")); printHostTime(out, hostMicros(deviceMicros()));
+      out.print(F(",\"p\":")); out.print(sync_Drift); out.println(F("}}"));
       break;
+#endif
     default:
+      printError(out, F("cmd"), cmd);
       break;
   }
+  endReply();
 }
 
 /**
@@ -735,9 +1750,9 @@ void loop()
 void drawBottomLine() {
   //Set x,y and print sensor data
   display.setPrintPos(0,64);
-  display.print(loadvoltage_OUT);   display.print("V ");
-  printJustified(current_mA);   display.print("mA ");
-  printJustified2(((float)current_mA*loadvoltage_OUT)/1000.00, 2); display.print("W"); 
+  display.print(loadvoltage_OUT);   display.print(F("V "));
+  printJustified(current_mA);   display.print(F("mA "));
+  printJustified2(((float)current_mA*loadvoltage_OUT)/1000.00, 2); display.print(F("W")); 
 }
 
 /**
@@ -746,7 +1761,7 @@ void drawBottomLine() {
  * @param none
  * @return none - output to display buffer
  */
-void drawScope(long now) {
+void drawScope(uint32_t now) {
   if(TIMEALL){updateTime(now,0);}
   for (uint8_t i=0; i < GRAPH_MEMORY; i++) {
     //uint8_t val = 54 - map(graph_Mem[(i+ring_idx)%GRAPH_MEMORY], 0, autoscale_limits[graph_MAX], 0, 54);
@@ -766,28 +1781,28 @@ void drawScope(long now) {
  * @param none
  * @return none - output to display buffer
  */
-void drawEnergy(long now) {
+void drawEnergy(uint32_t now) {
   if(TIMEENERGY){updateTime(now, 1);}
   display.setPrintPos(28,7);
-  display.print("Energy Usage");
+  display.print(F("Energy Usage"));
   display.drawHLine(0,7,128);
   display.setPrintPos(0,17);
   printJustified2(milliwatthours,2);
-  display.print("mWh ");
+  display.print(F("mWh "));
   display.setPrintPos(64,17);
   printJustified2(milliamphours,2);
-  display.print("mAh");
+  display.print(F("mAh"));
 
   display.setPrintPos(0,32);
-  display.print("Peak: ");
+  display.print(F("Peak: "));
   display.print((voltageAtPeakPower_OUT*currentAtPeakPower)/1000); 
-  display.print("W");
+  display.print(F("W"));
   display.setPrintPos(0,41);
-  display.print("@ ");
+  display.print(F("@ "));
   display.print(voltageAtPeakPower_OUT);
-  display.print("V & ");
+  display.print(F("V & "));
   display.print(currentAtPeakPower);
-  display.print("mA");
+  display.print(F("mA"));
   
   display.drawHLine(0,53,128);
 
@@ -800,28 +1815,64 @@ void drawEnergy(long now) {
  * @param none
  * @return none - output to display buffer
  */
-void drawPeakMins(long now) {
+void drawPeakMins(uint32_t now) {
   if(TIMEALL){updateTime(now,1);}
   display.setPrintPos(28,7);
-  display.print("Peak - Mins");
+  display.print(F("Peak - Mins"));
   display.drawHLine(0,7,128);
   display.setPrintPos(0,17);
-  display.print("Peak:");
+  display.print(F("Peak:"));
   printJustified(peakCurrent);
-  display.print("mA (");
+  display.print(F("mA ("));
   display.print(voltageAtPeakPower_OUT);
-  display.print("V) ");
+  display.print(F("V) "));
   display.setPrintPos(0,32);
-  display.print("Min:");
+  display.print(F("Min:"));
   display.print(minVoltage*0.001);
-  display.print("V (");
+  display.print(F("V ("));
   display.print(currentAtMinVoltage);
-  display.print("mA)");
+  display.print(F("mA)"));
   
   display.drawHLine(0,53,128);
 
 }
 
+#ifdef FEATURE_INRUSH
+/**
+ * Screen 6: Last inrush capture, peak and when it came, time to settle and charge
+ * 
+ * @param uint32 now pass millis
+ * @return none - output to display buffer
+ */
+void drawInrush(uint32_t now) {
+  if(TIMEALL){updateTime(now,1);}
+  display.setPrintPos(28,7);
+  display.print(F("Inrush"));
+  display.setPrintPos(80,7);
+  if (inrush_State <= INRUSH_STOP) display.print(F("N:1 arms"));
+  else if (inrush_State <= INRUSH_WAIT) display.print(F("wait low"));
+  else display.print(F("armed"));
+  display.drawHLine(0,7,128);
+  if (inrush_Count) {
+    display.setPrintPos(0,17);
+    display.print(F("Peak:"));
+    printJustified(inrush_Peak);
+    display.print(F("mA @"));
+    display.print(inrush_PeakAt * (INRUSH_PERIOD / 1000.0), 1);
+    display.print(F("ms"));
+    display.setPrintPos(0,29);
+    display.print(F("Settle: "));
+    display.print(inrush_Settle / 1000.0, 1);
+    display.print(F("ms"));
+    display.setPrintPos(0,41);
+    display.print(F("Charge: "));
+    display.print(inrush_Charge);
+    display.print(F("uC"));
+  }
+  display.drawHLine(0,53,128);
+}
+#endif
+
 /**
  * Screen 3: Displays one big value & unit, with X number of decimals
  * Display width is 7 digits wide, we leave the 2 rightmost digits for unit display
@@ -831,85 +1882,80 @@ void drawPeakMins(long now) {
  */
 void drawBig(float val, char* unit, uint8_t decimals) {
   display.setPrintPos(50,16);
-  display.setFont(u8g_font_10x20);
-  if ((decimals < 2) && (val < 1000)) display.print(" ");
-  if ((decimals < 1) && (val < 10000)) display.print(" ");
-  if (val < 100) display.print(" ");
-  if (val < 10) display.print(" ");
+  display.setFont(u8g_font_10x20r);
+  if ((decimals < 2) && (val < 1000)) display.print(F(" "));
+  if ((decimals < 1) && (val < 10000)) display.print(F(" "));
+  if (val < 100) display.print(F(" "));
+  if (val < 10) display.print(F(" "));
   display.print(val, decimals);
 
   display.print(unit);
-  display.setFont(u8g_font_6x12);
+  display.setFont(u8g_font_6x12r);
   
   
   display.drawRFrame(0,24,128,20,1);
   float limit = 0.0;
   if(unit == "W"){
     display.setPrintPos(0,7);
-    display.print("Peak:");
+    display.print(F("Peak:"));
     display.setPrintPos(0,16);
     display.print((voltageAtPeakPower_OUT*currentAtPeakPower)/1000);
-    display.print("W");
+    display.print(F("W"));
     
     float wattMax = 1.10;
     if(val > 10.10){limit = 0.201; wattMax = 25.10;}
     else if (val > 1.10){limit = 0.041; wattMax = 5.10;}
     else{limit = 0.009;} //1W range
-    for(int x = 2; x <= 126; x++){
-      if ((float)x <= ((float)val/limit)){display.drawVLine(x,26,16);}  
-    }
     //display.drawVLine((voltageAtPeakCurrent/limit),26,16);
-    display.drawVLine(0,44,8); 
-    display.setPrintPos(1,52); display.print("0");
-    display.drawVLine(64,44,8);
-    display.setPrintPos(32,52); display.print(wattMax/2);  
-    display.setPrintPos(97,52); display.print(wattMax);
-    display.drawVLine(127,44,8); 
+    drawScale(val, limit, 126, wattMax, "");
   }
  
   
   if(unit == "mA"){
     display.setPrintPos(0,7);
-    display.print("Peak:");
+    display.print(F("Peak:"));
     display.setPrintPos(0,16);
     display.print(peakCurrent);
-    display.print("mA");
+    display.print(F("mA"));
 
     limit = (float)autoscale_limits[graph_MAX]/127; 
-    for(int x = 2; x < 126; x++){
-      if (x <= (val/limit)){display.drawVLine(x,26,16);}  
-    }
     display.drawVLine((peakCurrent/limit),26,16);
-    display.drawVLine(0,44,8); 
-    display.setPrintPos(1,52); display.print("0");
-    display.drawVLine(64,44,8); 
-    display.setPrintPos(32,52); display.print(((autoscale_limits[graph_MAX]+0.0)/1000)/2); display.print("A");
-    display.setPrintPos(97,52); display.print((autoscale_limits[graph_MAX]+0.0)/1000); display.print("A");
-    display.drawVLine(127,44,8); 
+    drawScale(val, limit, 125, (autoscale_limits[graph_MAX]+0.0)/1000, "A");
   }
   if(unit == "V"){
     display.setPrintPos(0,7);
-    display.print("D+: ");
-    display.print(dpVoltage);
+    display.print(F("D+: "));
+    printFixed(display, (dpVoltage+5)/10, 2);
     display.setPrintPos(0,16);
-    display.print("D-: ");
-    display.print(dmVoltage);
+    display.print(F("D-: "));
+    printFixed(display, (dmVoltage+5)/10, 2);
   
     float voltMax = 5.10;
     if(val > 12.10){limit = 0.21; voltMax = 26.0;}
     else if (val > 5.10){limit = 0.098; voltMax = 12.10;}
     else{limit = 0.041;} //5V range
-    for(int x = 2; x <= 126; x++){
-      if ((float)x <= ((float)val/limit)){display.drawVLine(x,26,16);}  
-    }
     //display.drawVLine((voltageAtPeakCurrent/limit),26,16);
-    display.drawVLine(0,44,8); 
-    display.setPrintPos(1,52); display.print("0");
-    display.drawVLine(64,44,8);
-    display.setPrintPos(32,52); display.print(voltMax/2);  
-    display.setPrintPos(97,52); display.print(voltMax);
-    display.drawVLine(127,44,8); 
+    drawScale(val, limit, 126, voltMax, "");
+  }
+}
+
+/**
+ * Bar and scale under the big value of screen 3, shared by W, mA and V
+ * 
+ * @param float val value, float limit value per column, uint8 last column of the bar,
+ *        float max at the right end of the scale, char* unit after the scale labels
+ * @return none - output to display buffer
+ */
+void drawScale(float val, float limit, uint8_t last, float max, char* unit) {
+  for(int x = 2; x <= last; x++){
+    if ((float)x <= (val/limit)){display.drawVLine(x,26,16);}  
   }
+  display.drawVLine(0,44,8); 
+  display.setPrintPos(1,52); display.print(F("0"));
+  display.drawVLine(64,44,8);
+  display.setPrintPos(32,52); display.print(max/2); display.print(unit);
+  display.setPrintPos(97,52); display.print(max); display.print(unit);
+  display.drawVLine(127,44,8); 
 }
 
 /**
@@ -928,13 +1974,25 @@ void setMsg(char* msg, uint16_t time)
      current_screen=MSGSCREEN;
    }
 }
+/**
+ * Switches to a screen, ends a message still showing so it can't come back over it
+ * 
+ * @param uint8_t screen, taken modulo MAX_SCREENS as it may come from EEPROM
+ * @return none
+ */
+void setScreen(uint8_t screen)
+{
+  msgDisplay = false;
+  msgTime = 0;
+  current_screen = screen % MAX_SCREENS;
+}
 void drawMsg()
 {
   if (msgTime <= setDisplayTime){
   display.setPrintPos(0,16);
-  display.setFont(u8g_font_10x20);
+  display.setFont(u8g_font_10x20r);
   display.print(setMsgDisplay);
-  display.setFont(u8g_font_6x12);
+  display.setFont(u8g_font_6x12r);
   }
   
 }
@@ -999,45 +2057,494 @@ void drawGraph(uint16_t reading) {
   ring_idx = (ring_idx+1) & 0x7F; //modulus 127
 }
 
+// JSON stats report, bytes 0x01-0x04 are placeholders for the next value with
+// (byte-1) decimal places, so the report is built without any float math
+// 0x10+n starts the text of field group n (bit n of subFields), 0x1F ends it,
+// enabled groups are joined with ", "
+#define TPL_INT   "\x01"
+#define TPL_DEC2  "\x03"
+#define TPL_FRAC3 "\x05" //Integer zero padded to 3 digits, the part after a "."
+#define TPL_GROUP 0x10
+#define TPL_END   0x1F
+#define STATS_TEMPLATE \
+  "{ " \
+  "\x10" "\"a\":{ \"max\":" TPL_INT ", \"min\":" TPL_INT ", \"avg\":" TPL_DEC2 "}" \
+  "\x11" "\"v\":{ \"max\":" TPL_DEC2 ", \"min\":" TPL_DEC2 ", \"avg\":" TPL_DEC2 "}" \
+  "\x12" "\"mah\":" TPL_DEC2 \
+  "\x13" "\"mwh\":" TPL_DEC2 \
+  "\x14" "\"shunt\":" TPL_DEC2 \
+  "\x15" "\"dp\":" TPL_DEC2 ", \"dm\":" TPL_DEC2 \
+  "\x17" "\"ram\":" TPL_INT \
+  "\x16" "\"time\":" TPL_INT \
+  "\x18" "\"seq\":" TPL_INT \
+  "\x19" "\"ts\":" TPL_INT "." TPL_FRAC3 \
+  "\x1F" "}\r\n"
+const char statsTemplate[] PROGMEM = STATS_TEMPLATE;
+//Values of the report with every group subscribed, the size of the value list in serialOutput()
+#define STATS_VALUES 16
+//Placeholders and groups in a template, checked at compile time against STATS_VALUES and FIELD_ALL
+constexpr uint8_t tplCount(const char *t, char lo, char hi) { return *t ? (*t >= lo && *t <= hi) + tplCount(t + 1, lo, hi) : 0; }
+static_assert(tplCount(STATS_TEMPLATE, 0x01, 0x05) == STATS_VALUES, "STATS_VALUES must match the placeholders of the stats template");
+static_assert((FIELD_ALL >> tplCount(STATS_TEMPLATE, TPL_GROUP, TPL_END - 1)) == 0, "every FIELD_ group needs its text in the stats template");
+
+/**
+ * Print an integer as a fixed point number, 1234 with 2 decimals is 12.34
+ * 
+ * @param Print out destination
+ * @param uint32_t value already scaled by 10^decimals
+ * @param uint8_t decimals number of digits after the point
+ * @return none
+ */
+void printFixed(Print &out, uint32_t value, uint8_t decimals) {
+  uint32_t scale = 1;
+  for(uint8_t i = 0; i < decimals; i++) scale *= 10;
+  out.print(value / scale);
+  if(!decimals) return;
+  out.write('.');
+  uint32_t frac = value % scale;
+  while(scale /= 10){
+    out.write('0' + (frac / scale));
+    frac %= scale;
+  }
+}
+
+/**
+ * Print a PROGMEM template, replacing each placeholder byte (decimals+1)
+ * with the next entry of values, and skipping field groups not in groups
+ * 
+ * @param Print out destination
+ * @param PGM_P tpl template in flash
+ * @param uint32_t* values one per placeholder of the enabled groups, in order
+ * @param uint16_t groups bit n enables field group n
+ * @return none
+ */
+void printTemplate(Print &out, PGM_P tpl, const uint32_t *values, uint16_t groups) {
+  char c;
+  bool on = true;
+  bool first = true;
+  while((c = pgm_read_byte(tpl++))){
+    if(c >= TPL_GROUP && c < TPL_END){
+      on = groups & (1 << (c - TPL_GROUP));
+      if(on && !first) out.print(F(", "));
+      if(on) first = false;
+    }
+    else if(c == TPL_END) on = true;
+    else if(!on) continue;
+    else if(c < 5) printFixed(out, *values++, c-1);
+    else if(c == 5){
+      uint16_t frac = *values++;
+      if(frac < 100) out.write('0');
+      if(frac < 10) out.write('0');
+      out.print(frac);
+    }
+    else out.write(c);
+  }
+}
+
 /**
  * Called at set interval by main loop to update serial
  * 
- * @param none
+ * @param uint32 now current millis
+ * @return bool false if TX buffer was full and the report was dropped
+ */
+bool serialOutput(uint32_t now) {
+  if(!Serial) return false;
+  tx.begin(TX_STATS);
+#ifdef FEATURE_FRAMES
+  if(outputFormat == OUT_BINARY){
+    PROF_BEGIN(profFormat);
+    serialOutputFrame(now);
+    PROF_END(profFormat, PROF_FORMAT);
+    return tx.end();
+  }
+#endif
+  //Only subscribed values are computed, in template order
+  uint32_t samples;
+  uint64_t mASum, mVSum;
+  periodSums(samples, mASum, mVSum);
+  uint32_t values[STATS_VALUES];
+  uint8_t n = 0;
+  if(subFields & FIELD_A){
+    values[n++] = rpPeakCurrent;
+    values[n++] = rpMinCurrent;
+    values[n++] = (mASum*100 + samples/2)/samples;
+  }
+  if(subFields & FIELD_V){
+    values[n++] = (rpPeakLoadVolt+5)/10;
+    values[n++] = (rpMinLoadVolt+5)/10;
+    values[n++] = (mVSum/samples+5)/10;
+  }
+  if(subFields & FIELD_MAH) values[n++] = (energy_uAh()+5)/10;
+  if(subFields & FIELD_MWH) values[n++] = (energy_uWh()+5)/10;
+  if(subFields & FIELD_SHUNT) values[n++] = shuntvoltage;
+  if(subFields & FIELD_DPDM){
+    values[n++] = (dpVoltage+5)/10;
+    values[n++] = (dmVoltage+5)/10;
+  }
+  if(subFields & FIELD_RAM) values[n++] = memFree();
+  if(subFields & FIELD_TIME) values[n++] = now-uptimeOldMills;
+  if(subFields & FIELD_SEQ) values[n++] = tx.seq[TX_STATS];
+#ifdef FEATURE_SYNC
+  if(subFields & FIELD_TS){
+    uint64_t ts = hostMicros(deviceMicros());
+    values[n++] = ts / 1000;
+    values[n++] = ts % 1000;
+  }
+#endif
+  PROF_BEGIN(profFormat);
+  printTemplate(tx, statsTemplate, values, subFields);
+  PROF_END(profFormat, PROF_FORMAT);
+  return tx.end();
+}
+
+#ifdef FEATURE_FRAMES
+/**
+ * Binary version of serialOutput, FRAME_STATS payload (little-endian):
+ * uint16 field mask (subFields), then for each subscribed group in bit order
+ * FIELD_A: uint16 max mA, uint16 min mA, uint32 avg in 0.01mA
+ * FIELD_V: uint16 max mV, uint16 min mV, uint16 avg mV
+ * FIELD_MAH: uint32 uAh, FIELD_MWH: uint32 uWh (both wrap, uWh after 4295Wh), FIELD_SHUNT: uint16 shunt in 10uV
+ * FIELD_DPDM: uint16 D+ mV, uint16 D- mV, FIELD_TIME: uint32 time in ms, FIELD_RAM: uint16 free SRAM
+ * FIELD_TS: uint32 host aligned ms, uint16 us
+ * 
+ * @param uint32 now current millis
  * @return none - output to serial of current data
  */
-void serialOutput(long now) {
-  if(Serial){
-    Serial.print("{ \"a\":{ \"max\":");
-    Serial.print(rpPeakCurrent);
-    Serial.print(", \"min\":");
-    Serial.print(rpMinCurrent);
-    Serial.print(", \"avg\":");
-    Serial.print(rpAvgCurrent);
-    Serial.print("}, \"v\":{ \"max\":");
-    Serial.print(rpPeakLoadVolt*0.001);
-    Serial.print(", \"min\":");
-    Serial.print(rpMinLoadVolt*0.001);
-    Serial.print(", \"avg\":");
-    Serial.print(rpAvgLoadVolt*0.001);
-    Serial.print("}, \"mah\":");
-    Serial.print(milliamphours);
-    Serial.print(", \"mwh\":");
-    Serial.print(milliwatthours);
-    Serial.print(", \"shunt\":");
-    Serial.print(shuntvoltage*0.01);
-    Serial.print(", \"dp\":");
-    Serial.print(dpVoltage);
-    Serial.print(", \"dm\":");
-    Serial.print(dmVoltage);
-    #ifdef DEBUG
-    	Serial.print(", \"ram\":");
-    	Serial.print(freeRam());
-    #endif
-    Serial.print(", \"time\":");
-    Serial.print(now-uptimeOldMills);
-    Serial.println("}");
+void serialOutputFrame(uint32_t now) {
+  uint32_t samples;
+  uint64_t mASum, mVSum;
+  periodSums(samples, mASum, mVSum);
+  frame.begin(FRAME_STATS, frameSeq[FRAME_STATS]++);
+  frame.put16(subFields);
+  if(subFields & FIELD_A){
+    frame.put16(rpPeakCurrent);
+    frame.put16(rpMinCurrent);
+    frame.put32((mASum*100)/samples);
   }
-  
+  if(subFields & FIELD_V){
+    frame.put16(rpPeakLoadVolt);
+    frame.put16(rpMinLoadVolt);
+    frame.put16(mVSum/samples);
+  }
+  if(subFields & FIELD_MAH) frame.put32(energy_uAh());
+  if(subFields & FIELD_MWH) frame.put32(energy_uWh());
+  if(subFields & FIELD_SHUNT) frame.put16(shuntvoltage);
+  if(subFields & FIELD_DPDM){
+    frame.put16(dpVoltage);
+    frame.put16(dmVoltage);
+  }
+  if(subFields & FIELD_TIME) frame.put32(now-uptimeOldMills);
+  if(subFields & FIELD_RAM) frame.put16(memFree());
+#ifdef FEATURE_SYNC
+  if(subFields & FIELD_TS){
+    uint64_t ts = hostMicros(deviceMicros());
+    frame.put32(ts / 1000);
+    frame.put16(ts % 1000);
+  }
+#endif
+  frame.end(tx);
+}
+
+/**
+ * Sends queued raw samples as FRAME_RAW frames, called every loop while streaming
+ * Payload: uint32 sample number of first sample (counting streamed samples, one every rawRate), then for each sample
+ * zigzag varint of mA and mV change from previous sample (first one from 0)
+ * A frame never spans a drop, so the host can rebuild timing from sample numbers
+ * 
+ * @param none
+ * @return none - output to serial
+ */
+void rawOutput() {
+  if(!Serial){
+    raw_tail = raw_head;
+    return;
+  }
+  //Leave samples queued while TX is full, the ISR counts what it cannot store
+  while (raw_tail != raw_head && tx.room(TX_RAW) >= 64) {
+    //Low byte from the ISR moves raw_seq past any samples dropped in between
+    raw_seq += (uint8_t)(raw_Seq[raw_tail] - (uint8_t)raw_seq);
+    tx.begin(TX_RAW);
+    frame.begin(FRAME_RAW, frameSeq[FRAME_RAW]++);
+    frame.put32(raw_seq);
+    uint16_t lastCurrent = 0;
+    uint16_t lastVolt = 0;
+    //Worst case sample is two 3 byte varints
+    while (raw_tail != raw_head && (frame.length() - FRAME_HEADER_SIZE + 6) <= RAW_FRAME_PAYLOAD) {
+      if (raw_Seq[raw_tail] != (uint8_t)raw_seq) break;
+      uint16_t c = raw_Current[raw_tail];
+      uint16_t v = raw_Volt[raw_tail];
+      frame.putZigzag(c - lastCurrent);
+      frame.putZigzag(v - lastVolt);
+      lastCurrent = c;
+      lastVolt = v;
+      raw_tail = (raw_tail+1) & (RAW_MEMORY-1);
+      raw_seq++;
+    }
+    frame.end(tx);
+    tx.end();
+  }
+}
+#endif
+
+#ifdef FEATURE_SYNC
+/**
+ * Device time in us since boot, micros() extended to 64 bit
+ * Called every loop so no wrap of micros() (71 minutes) is missed
+ * 
+ * @param none
+ * @return uint64_t device us
+ */
+uint64_t deviceMicros() {
+  uint32_t now = micros();
+  clock_Micros += (uint32_t)(now - clock_Last);
+  clock_Last = now;
+  return clock_Micros;
+}
+
+/**
+ * Converts device time to the host timebase set with Y:
+ * Before any sync this is device time
+ * 
+ * @param uint64_t dev device us from deviceMicros()
+ * @return uint64_t host us
+ */
+uint64_t hostMicros(uint64_t dev) {
+  int64_t elapsed = dev - sync_DevRef;
+  return sync_HostRef + elapsed + elapsed * sync_Drift / 1000000;
+}
+
+/**
+ * Prints a host time in ms with 3 decimals
+ * 
+ * @param Print out destination
+ * @param uint64_t us host us
+ * @return none
+ */
+void printHostTime(Print &out, uint64_t us) {
+  uint16_t frac = us % 1000;
+  out.print((uint32_t)(us / 1000));
+  out.write('.');
+  if(frac < 100) out.write('0');
+  if(frac < 10) out.write('0');
+  out.print(frac);
+}
+#endif
+
+#ifdef FEATURE_FRAMES
+/**
+ * Size of a dumpable buffer
+ * 
+ * @param int32_t buf DUMP_HISTORY or DUMP_CAPTURE
+ * @return uint16_t number of values, 0 for an unknown or empty buffer
+ */
+uint16_t dumpSize(int32_t buf) {
+  if (buf == DUMP_HISTORY) return GRAPH_MEMORY;
+  if (buf == DUMP_CAPTURE) return capture_Count; //What has been captured so far
+  return 0;
+}
+
+/**
+ * Sends the next chunks of a dump started with X: as FRAME_DUMP frames
+ * while the TX buffer has room, the rest goes on the next loops
+ * Payload: uint8 buffer, uint16 offset of first value, then up to DUMP_CHUNK uint16 values
+ * The frame CRC covers each chunk, a host that misses one resumes with X:B,offset
+ * 
+ * @param none
+ * @return none - output to serial
+ */
+void dumpOutput() {
+  if(!Serial){
+    dump_End = dump_Offset;
+    return;
+  }
+  while (dump_Offset < dump_End && tx.room(TX_RAW) >= 64) {
+    uint8_t n = min(dump_End - dump_Offset, DUMP_CHUNK);
+    tx.begin(TX_RAW);
+    frame.begin(FRAME_DUMP, frameSeq[FRAME_DUMP]);
+    frame.put8(dump_Buf);
+    frame.put16(dump_Offset);
+    for (uint8_t i = 0; i < n; i++) {
+      uint16_t value;
+      if (dump_Buf == DUMP_HISTORY) {
+        value = graph_Mem_ORG[dump_Offset + i];
+      } else {
+        noInterrupts();
+        value = capture_Mem[dump_Offset + i];
+        interrupts();
+      }
+      frame.put16(value);
+    }
+    frame.end(tx);
+    if (!tx.end()) break; //Try the same chunk again next loop
+    frameSeq[FRAME_DUMP]++;
+    dump_Offset += n;
+  }
+}
+#endif
+
+#ifdef FEATURE_DIAG
+/**
+ * Sends the task stats started with L?, one task per reply while the TX
+ * buffer has room, the rest goes on the next loops
+ * {"L":"task","n":runs,"avg":us,"max":us,"miss":missed deadlines}
+ * n and avg cover the latest runs, both are halved when n is full
+ * 
+ * @param none
+ * @return none - output to TX buffer
+ */
+void schedOutput() {
+  if(!Serial){
+    sched_Next = TASKS;
+    return;
+  }
+  while (sched_Next < TASKS && tx.room(TX_REPLY) >= 80) {
+    schedStats &st = sched_Stats[sched_Next];
+    Print &out = beginReply();
+    out.print(F("{\"L\":\"")); out.print((const __FlashStringHelper *)sched.name(sched_Next));
+    out.print(F("\",\"n\":")); out.print(st.runs);
+    out.print(F(",\"avg\":")); out.print(st.runs ? st.sum / st.runs : 0);
+    out.print(F(",\"max\":")); out.print(st.max);
+    out.print(F(",\"miss\":")); out.print(st.missed); out.println(F("}"));
+    endReply();
+    sched_Next++;
+  }
+  if (sched_Next == TASKS && sched_Reset) {
+    sched.reset();
+    sched_Reset = false;
+  }
+}
+#endif
+
+#ifdef PROFILE
+/**
+ * Sends the profile table started with H?, one zone per reply while the
+ * TX buffer has room, the rest goes on the next loops
+ * {"H":"zone","n":count,"min":cycles,"avg":cycles,"max":cycles}
+ * 
+ * @param none
+ * @return none - output to TX buffer
+ */
+void profOutput() {
+  if(!Serial){
+    prof_Next = PROF_ZONES;
+    return;
+  }
+  while (prof_Next < PROF_ZONES && tx.room(TX_REPLY) >= 96) {
+    noInterrupts();
+    profEntry e = profTable[prof_Next];
+    interrupts();
+    Print &out = beginReply();
+    out.print(F("{\"H\":\"")); out.print((const __FlashStringHelper *)profName(prof_Next));
+    out.print(F("\",\"n\":")); out.print(e.count);
+    out.print(F(",\"min\":")); out.print(e.min);
+    out.print(F(",\"avg\":")); out.print(e.count ? (uint32_t)(e.sum / e.count) : 0);
+    out.print(F(",\"max\":")); out.print(e.max); out.println(F("}"));
+    endReply();
+    prof_Next++;
+  }
+  if (prof_Next == PROF_ZONES && prof_Reset) {
+    profReset();
+    prof_Reset = false;
+  }
+}
+#endif
+
+#ifdef FEATURE_DIAG
+/**
+ * Prints telemetry: messages dropped and sequence number of the next message
+ * per TX class (reply, event, stats, raw, telemetry),
+ * stats reports coalesced and raw samples the ISR could not queue
+ * Kept short enough for a FRAME_TEXT frame
+ * 
+ * @param Print to write to
+ * @return none
+ */
+void printTelemetry(Print &out) {
+  out.print(F("{\"T\":{\"d\":["));
+  for (uint8_t i = 0; i < TX_CLASSES; i++) {
+    if (i) out.print(F(","));
+    out.print(tx.dropped[i]);
+  }
+  out.print(F("],\"s\":["));
+  for (uint8_t i = 0; i < TX_CLASSES; i++) {
+    if (i) out.print(F(","));
+    out.print(tx.seq[i]);
+  }
+  out.print(F("],\"c\":")); out.print(statsCoalesced);
+#ifdef FEATURE_FRAMES
+  out.print(F(",\"r\":")); out.print(raw_dropped);
+#endif
+  out.println(F("}}"));
+}
+#endif
+
+/**
+ * Starts a command reply (or other JSON message), JSON goes straight to the TX buffer
+ * in binary mode it is collected into a FRAME_TEXT frame
+ * 
+ * @param txClass TX class of the message, TX_REPLY for command replies
+ * @return Print to write the reply to
+ */
+Print& beginReply(txClass cls) {
+  tx.begin(cls);
+#ifdef FEATURE_FRAMES
+  replyFramed = (outputFormat == OUT_BINARY);
+  if(replyFramed){
+    frame.begin(FRAME_TEXT, frameSeq[FRAME_TEXT]++);
+    return frame;
+  }
+#endif
+  return tx;
+}
+
+/**
+ * Queues a reply started with beginReply
+ * 
+ * @param none
+ * @return none - output to TX buffer
+ */
+void endReply() {
+#ifdef FEATURE_FRAMES
+  if(replyFramed) frame.end(tx);
+  replyFramed = false;
+#endif
+  tx.end();
+}
+
+/**
+ * Energy totals from the ISR accumulators, integer math only
+ * ACC*READFREQ/3.6e9 is mAh, so uAh is ACC/(3.6e6/READFREQ)
+ * 
+ * @param none
+ * @return uint64 uAh or uWh since last reset
+ */
+uint64_t energy_uAh() {
+  noInterrupts();
+  uint64_t acc = milliamphours_ACC;
+  interrupts();
+  return acc / (uint32_t)(3.6e6/READFREQ);
+}
+
+uint64_t energy_uWh() {
+  noInterrupts();
+  uint64_t acc = milliwatthours_ACC;
+  interrupts();
+  return acc / (uint32_t)(3.6e9/READFREQ);
+}
+
+/**
+ * Copy of the report period accumulators taken with the ISR held off,
+ * they are wider than one instruction can read
+ * 
+ * @param uint32 samples, uint64 mASum, uint64 mVSum - set to the period so far
+ * @return none
+ */
+void periodSums(uint32_t &samples, uint64_t &mASum, uint64_t &mVSum) {
+  noInterrupts();
+  samples = rpSamples ? rpSamples : 1; //None yet right after boot
+  mASum = currentmA_ACC;
+  mVSum = loadvoltage_ACC;
+  interrupts();
 }
 
 /**
@@ -1047,9 +2554,9 @@ void serialOutput(long now) {
  * @return none - output to display buffer
  */
 void printJustified(uint16_t val) {
-  if (val < 1000) display.print(" ");
-  if (val < 100) display.print(" ");
-  if (val < 10) display.print(" ");
+  if (val < 1000) display.print(F(" "));
+  if (val < 100) display.print(F(" "));
+  if (val < 10) display.print(F(" "));
   display.print(val); 
 }
 
@@ -1063,9 +2570,9 @@ void printJustified(uint16_t val) {
 void printJustified2(float val, uint8_t dec)
 {
   //val = floor(val + 0.5);
-  if (val < 1000) display.print(" ");
-  if (val < 100) display.print(" ");
-  if (val < 10) display.print(" ");
+  if (val < 1000) display.print(F(" "));
+  if (val < 100) display.print(F(" "));
+  if (val < 10) display.print(F(" "));
   display.print(val,dec); 
 }
 
@@ -1080,19 +2587,6 @@ uint8_t mapS(uint16_t x) //, uint16_t in_min, uint16_t in_max, uint16_t out_min,
   return 54-((x*54) / autoscale_limits[graph_MAX]);
 }
 
-/**
- * Calculates free SRAM - from Arduino Playground
- * 
- * @param none
- * @return int of free SRAM
- */
-#ifdef DEBUG
-int freeRam () {
-  extern int __heap_start, *__brkval;
-  int v;
-  return (int) &v - (__brkval == 0 ? (int) &__heap_start : (int) __brkval);
-}
-#endif
 /**
  * Handles setting screen and reseting points\
  * Can be used to add function based on 2+ clicks
@@ -1115,7 +2609,7 @@ void setButtonMode(int8_t btnClicks){
         uptimeOldMills = millis();
         break;
     case 1:
-        current_screen = (current_screen + 1) % MAX_SCREENS;
+        setScreen((current_screen + 1) % MAX_SCREENS);
     break;
    //default:
    
@@ -1153,10 +2647,10 @@ long readVcc() {
  * depending on screen we are currently on.
  * Time is reset with offset when RESET command is run.
  * 
- * @param long now current millis, uint8 page we are on to set draw location
+ * @param uint32 now current millis, uint8 page we are on to set draw location
  * @return none -  output to display buffer
  */
-void updateTime(long now, uint8_t page)
+void updateTime(uint32_t now, uint8_t page)
 {   
   long hours=0;
   long mins=0;
@@ -1172,9 +2666,9 @@ void updateTime(long now, uint8_t page)
   if(page){display.setPrintPos(0,50);}
   //display.print(F("Time: "));
   display.print(hours);
-  display.print(":");
+  display.print(F(":"));
   display.print(mins);
-  display.print(":");
+  display.print(F(":"));
   display.print(secs);
 }
 
@@ -1185,20 +2679,77 @@ void updateTime(long now, uint8_t page)
  * @return none -  output to serial port
  */
 void sendEvent (int16_t threshhold){
-  if(Serial){ 
-      Serial.print("{ \"event\":{ \"i\":");
-      Serial.print(eventStatus);
-      Serial.print(", \"t\":");
-      Serial.print(eventTime);
-      Serial.print(", \"c\":");
-      Serial.print(eventType);
-      Serial.print(", \"a\":");
-      Serial.print(current_mA);
-      Serial.print(", \"w\":");
-      Serial.print(threshhold);
-      Serial.println("}}");
+  if(!Serial) return;
+#ifdef FEATURE_SYNC
+  uint64_t ts = hostMicros(deviceMicros());
+#endif
+  tx.begin(TX_EVENT);
+#ifdef FEATURE_FRAMES
+  if(outputFormat == OUT_BINARY){
+    //FRAME_EVENT payload: uint8 status, uint32 time ms, uint8 type, uint16 mA, int16 threshold
+    //with FIELD_TS uint32 host aligned ms, uint16 us
+    frame.begin(FRAME_EVENT, frameSeq[FRAME_EVENT]++);
+    frame.put8(eventStatus);
+    frame.put32(eventTime);
+    frame.put8(eventType);
+    frame.put16(current_mA);
+    frame.put16(threshhold);
+#ifdef FEATURE_SYNC
+    if(subFields & FIELD_TS){
+      frame.put32(ts / 1000);
+      frame.put16(ts % 1000);
+    }
+#endif
+    frame.end(tx);
+  } else
+#endif
+  {
+      tx.print(F("{ \"event\":{ \"i\":"));
+      tx.print(eventStatus);
+      tx.print(F(", \"t\":"));
+      tx.print(eventTime);
+      tx.print(F(", \"c\":"));
+      tx.print(eventType);
+      tx.print(F(", \"a\":"));
+      tx.print(current_mA);
+      tx.print(F(", \"w\":"));
+      tx.print(threshhold);
+      if(subFields & FIELD_SEQ){
+        tx.print(F(", \"seq\":"));
+        tx.print(tx.seq[TX_EVENT]);
+      }
+#ifdef FEATURE_SYNC
+      if(subFields & FIELD_TS){
+        tx.print(F(", \"ts\":"));
+        printHostTime(tx, ts);
+      }
+#endif
+      tx.println(F("}}"));
   }
+  tx.end();
+}
+
+#ifdef FEATURE_INRUSH
+/**
+ * Sends the results of the last inrush capture, in a FRAME_TEXT frame in binary mode
+ * 
+ * @param uint32 time ms since boot or Z: of the report
+ * @return none - output to TX buffer
+ */
+void sendInrush(uint32_t time) {
+  if(!Serial) return;
+  Print &out = beginReply(TX_EVENT);
+  out.print(F("{\"inrush\":{\"t\":")); out.print(time);
+  out.print(F(",\"pk\":")); out.print(inrush_Peak);
+  out.print(F(",\"tpk\":")); out.print((uint32_t)inrush_PeakAt * INRUSH_PERIOD);
+  out.print(F(",\"st\":")); out.print(inrush_Settle);
+  out.print(F(",\"uc\":")); out.print(inrush_Charge);
+  out.print(F(",\"a\":")); out.print(inrush_Final);
+  out.print(F(",\"n\":")); out.print(inrush_Total);
+  out.print(F(",\"skip\":")); out.print(inrush_Skipped); out.println(F("}}"));
+  endReply();
 }
+#endif
 
 /**
  * Loads config from EEPROM
@@ -1209,6 +2760,8 @@ void sendEvent (int16_t threshhold){
  * @return bool if saved config matches code config version
  */
 bool loadConfig() {
+  //Finish a save still being written first
+  while (taskEEPROM(0));
   EEPROM.readBlock(configAdress, savedConfig);
   return !strcmp(savedConfig.version, CONFIG_VERSION);
 }
@@ -1222,6 +2775,7 @@ bool loadConfig() {
  * @return none - saves to EEPROM
  */
 void saveConfig() {
-   EEPROM.updateBlock(configAdress, savedConfig);
+   //Written in the background by taskEEPROM()
+   config_Next = 0;
 }
 
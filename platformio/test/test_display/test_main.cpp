@@ -0,0 +1,146 @@
+/*
+  Display output through the SSD1306 model, run with pio test -e native
+
+  Screens are compared with the PBM images in test/test_display/golden.
+  A missing image is written from the current render and the test is
+  ignored, check it by eye (or convert it to PNG) before committing.
+*/
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include "Arduino.h"
+#include "Wire.h"
+#include "INA219Model.h"
+#include "SSD1306Model.h"
+
+#define GOLDEN_DIR "test/test_display/golden/"
+#define SPLASH_MS 1700
+
+extern U8GLIB_SSD1306_128X64 display;
+
+INA219Model ina;
+SSD1306Model oled;
+
+void run(uint32_t ms)
+{
+  for (uint64_t end = native_micros + ms * 1000ULL; native_micros < end; ) {
+    loop();
+    native_advance(1000);
+  }
+}
+
+// setup() and the splash, which no longer holds up the loop
+void boot()
+{
+  setup();
+  run(SPLASH_MS);
+}
+
+void setUp(void)
+{
+  native_reset();
+  ina.set(5000, 500);
+  Wire.attach(INA219_MODEL_ADDRESS, &ina);
+  oled.reset();
+  oled.attach(display.getU8g());
+}
+
+void tearDown(void) {}
+
+// Compares the panel with the golden image, false if there was none and it got written
+bool checkGolden(const char *name)
+{
+  std::string path = std::string(GOLDEN_DIR) + name + ".pbm";
+  std::string img = oled.pbm();
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) {
+    TEST_ASSERT_TRUE(oled.writePBM(path.c_str()));
+    return false;
+  }
+  std::string golden(img.size() + 1, 0);
+  golden.resize(fread(&golden[0], 1, golden.size(), f));
+  fclose(f);
+  TEST_ASSERT_TRUE_MESSAGE(golden == img, path.c_str());
+  return true;
+}
+
+void test_init_sequence(void)
+{
+  TEST_ASSERT_TRUE(oled.on);
+  TEST_ASSERT_TRUE(oled.chargePump);
+  TEST_ASSERT_TRUE(oled.segRemap);
+  TEST_ASSERT_TRUE(oled.comReverse);
+  TEST_ASSERT_EQUAL_HEX8(0xCF, oled.contrast);
+  TEST_ASSERT_EQUAL(63, oled.mux);
+  TEST_ASSERT_EQUAL(0, oled.frames);
+}
+
+void test_splash(void)
+{
+  setup();
+  // U8glib sends the init sequence again with the first page after boot
+  TEST_ASSERT_EQUAL(1, oled.frames);
+  TEST_ASSERT_EQUAL_HEX8(0xFF, oled.last.pages);
+  TEST_ASSERT_EQUAL(1024, oled.last.data);
+  bool golden = checkGolden("splash");
+  // Left up while sampling runs, the screens follow
+  run(SPLASH_MS - 100);
+  TEST_ASSERT_EQUAL(1, oled.frames);
+  run(200);
+  TEST_ASSERT_TRUE(oled.frames > 1);
+  if (!golden) TEST_IGNORE_MESSAGE("golden image written");
+}
+
+void test_frame_traffic(void)
+{
+  boot();
+  run(1000);
+  // Every page in full, 3 addressing commands per page
+  TEST_ASSERT_EQUAL_HEX8(0xFF, oled.last.pages);
+  TEST_ASSERT_EQUAL(1024, oled.last.data);
+  TEST_ASSERT_EQUAL(24, oled.last.commands);
+  TEST_ASSERT_EQUAL(1048, oled.last.bytes);
+  // 100ms refresh
+  TEST_ASSERT_TRUE(oled.frames >= 10);
+}
+
+void test_screens(void)
+{
+  static const char *names[] = {"scope", "energy", "peak", "watts", "amps", "volts", "inrush"};
+  char cmd[8];
+  bool written = false;
+  boot();
+  // Energy and run time start from zero whatever ran before
+  Serial.inject("Z:\n");
+  for (uint8_t s = 0; s < 7; s++) {
+    sprintf(cmd, "S:%u\n", s + 1);
+    Serial.inject(cmd);
+    run(500);
+    if (!checkGolden(names[s])) written = true;
+  }
+  if (written) TEST_IGNORE_MESSAGE("golden images written");
+}
+
+void test_display_off(void)
+{
+  boot();
+  Serial.inject("D:0\n");
+  run(500);
+  uint32_t frames = oled.frames;
+  run(500);
+  // Pages are still sent, only blank
+  TEST_ASSERT_TRUE(oled.frames > frames);
+  Serial.inject("D:1\n");
+  run(200);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_init_sequence);
+  RUN_TEST(test_splash);
+  RUN_TEST(test_frame_traffic);
+  RUN_TEST(test_screens);
+  RUN_TEST(test_display_off);
+  return UNITY_END();
+}
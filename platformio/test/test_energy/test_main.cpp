@@ -0,0 +1,205 @@
+/*
+  Energy accounting against a double precision reference, run with pio test -e native
+
+  Synthetic loads run through the sampling ISR and the report path for
+  hours of virtual time, the mah/mwh in the last report are compared with
+  the exact integral of the trace. The error is printed in ppm.
+
+  Runs are 24h by default, pass the number of hours to go longer, e.g. a
+  week: pio test -e native -f test_energy -a 168
+  The display is off and the loop steps 100ms so a day takes well under
+  a minute on the host.
+*/
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "Arduino.h"
+#include "Wire.h"
+#include "INA219Model.h"
+
+#define ENERGY_HOURS 24
+#define ENERGY_STEP_US 100000
+#define ENERGY_MAX_PPM 50
+
+extern volatile uint64_t milliwatthours_ACC;
+extern volatile uint64_t milliamphours_ACC;
+
+INA219Model ina;
+static uint32_t hours = ENERGY_HOURS;
+static std::string report;
+
+// Load of base_mA plus extra_mA for width_ms every period_ms, at bus_mV
+struct Load {
+  float bus_mV;
+  float base_mA;
+  float extra_mA;
+  uint32_t period_ms;
+  uint32_t width_ms;
+};
+
+// Exact charge in mAs from the start of the trace to t_ms
+double charge(const Load &l, uint64_t t_ms)
+{
+  uint64_t on = (t_ms / l.period_ms) * l.width_ms;
+  uint64_t rem = t_ms % l.period_ms;
+  on += rem < l.width_ms ? rem : l.width_ms;
+  return (l.base_mA * (double)t_ms + l.extra_mA * (double)on) / 1000.0;
+}
+
+// Keeps the last complete report and drops the rest of the output
+void collect()
+{
+  std::string &out = Serial.output;
+  size_t end = out.rfind("}\r\n");
+  size_t start = end == std::string::npos ? std::string::npos : out.rfind("{ \"a\"", end);
+  if (start != std::string::npos) report = out.substr(start, end + 1 - start);
+  out.clear();
+}
+
+void run(uint64_t ms)
+{
+  for (uint64_t end = native_micros + ms * 1000ULL; native_micros < end; ) {
+    loop();
+    native_advance(ENERGY_STEP_US);
+    if (Serial.output.size() > 4096) collect();
+  }
+  collect();
+}
+
+double field(const std::string &line, const char *key)
+{
+  std::string k = std::string("\"") + key + "\":";
+  size_t p = line.find(k);
+  return p == std::string::npos ? -1 : atof(line.c_str() + p + k.size());
+}
+
+void setUp(void)
+{
+  native_reset();
+  report.clear();
+  ina.set(5000, 500);
+  Wire.attach(INA219_MODEL_ADDRESS, &ina);
+  setup();
+  Serial.inject("D:0\n");
+  run(1000);
+}
+
+void tearDown(void)
+{
+  Serial.inject("D:1\n");
+  run(200);
+}
+
+// Runs the load from a reset of the totals and checks the last report
+void checkLoad(const Load &l, uint32_t h)
+{
+  Serial.inject("Z:\n");
+  loop();
+  ina.set(l.bus_mV, l.base_mA);
+  ina.burst(native_micros, l.period_ms * 1000, l.width_ms * 1000, l.extra_mA);
+  run(h * 3600000ULL);
+
+  double t = field(report, "time");
+  TEST_ASSERT_TRUE_MESSAGE(t > 0, report.c_str());
+  // The trace starts with the totals
+  double mAs = charge(l, (uint64_t)t);
+  double mah = mAs / 3600.0;
+  double mwh = mah * l.bus_mV / 1000.0;
+  double mahErr = (field(report, "mah") - mah) / mah * 1e6;
+  double mwhErr = (field(report, "mwh") - mwh) / mwh * 1e6;
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%uh %.0fmV: mah %.2f ref %.2f (%+.1f ppm), mwh %.2f ref %.2f (%+.1f ppm)",
+    h, l.bus_mV, field(report, "mah"), mah, mahErr, field(report, "mwh"), mwh, mwhErr);
+  TEST_MESSAGE(msg);
+  // Reports must still be on time at the end of the run
+  TEST_ASSERT_TRUE_MESSAGE(t >= h * 3600000.0 - 2000, msg);
+  TEST_ASSERT_TRUE_MESSAGE(fabs(mahErr) < ENERGY_MAX_PPM, msg);
+  TEST_ASSERT_TRUE_MESSAGE(fabs(mwhErr) < ENERGY_MAX_PPM, msg);
+}
+
+void test_long_run(void)
+{
+  // 500mA with 1A on top for 2s every 10s, 700mA on average
+  Load l = {5000, 500, 1000, 10000, 2000};
+  checkLoad(l, hours);
+}
+
+void test_high_power(void)
+{
+  // 20V and up to 3A, close to the top of the 32V/3.2A calibration
+  Load l = {20000, 1500, 1500, 60000, 30000};
+  checkLoad(l, hours / 4 ? hours / 4 : 1);
+}
+
+void test_large_totals(void)
+{
+  // Past 2^32 uWh (4295Wh), where a 32 bit total wraps
+  Serial.inject("Z:\n");
+  run(10);
+  noInterrupts();
+  // ACC is uW (uA) per 1ms sample, 3.6e6 (3600) of them per uWh (uAh)
+  milliwatthours_ACC = 5000000000ULL * 3600000ULL;
+  milliamphours_ACC = 1000000000ULL * 3600ULL;
+  interrupts();
+  ina.set(5000, 0);
+  run(1500);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 5000000.0, field(report, "mwh"));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 1000000.0, field(report, "mah"));
+}
+
+void test_long_report_period(void)
+{
+  // Over 65535 samples in one period, a 16 bit count wrapped and divided by zero at 65536
+  // A report first, the long period then starts from a 500mA sample
+  run(1500);
+  Serial.inject("R:65535\n");
+  run(70000);
+  TEST_ASSERT_TRUE(field(report, "time") > 65000);
+  TEST_ASSERT_EQUAL_FLOAT(500.0, field(report, "avg"));
+  TEST_ASSERT_EQUAL(500, field(report, "max"));
+  Serial.inject("R:1000\n");
+  run(1500);
+}
+
+// Starts the firmware ms before millis() reaches wrap_ms and runs across it
+void checkWrap(uint64_t wrap_ms)
+{
+  native_reset((wrap_ms - 60000) * 1000);
+  ina.set(5000, 500);
+  setup();
+  Serial.inject("D:0\nZ:\n");
+  run(120000);
+  double t = field(report, "time");
+  char msg[64];
+  snprintf(msg, sizeof(msg), "time %.0f at %llums", t, (unsigned long long)(native_micros / 1000));
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE_MESSAGE(t > 118000 && t <= 120000, msg);
+  // 500mA for the reported time, to the 10uAh the report shows
+  TEST_ASSERT_FLOAT_WITHIN(0.02, 500.0 * t / 3600000.0, field(report, "mah"));
+}
+
+void test_millis_wrap(void)
+{
+  // millis() wraps after 49.7 days
+  checkWrap(1ULL << 32);
+}
+
+void test_millis_sign(void)
+{
+  // 24.8 days, where millis() turns negative as a long
+  checkWrap(1ULL << 31);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1 && atoi(argv[1]) > 0) hours = atoi(argv[1]);
+  UNITY_BEGIN();
+  RUN_TEST(test_long_run);
+  RUN_TEST(test_high_power);
+  RUN_TEST(test_large_totals);
+  RUN_TEST(test_long_report_period);
+  RUN_TEST(test_millis_wrap);
+  RUN_TEST(test_millis_sign);
+  return UNITY_END();
+}
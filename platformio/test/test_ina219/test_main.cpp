@@ -0,0 +1,169 @@
+/*
+  INA219 driver against the register model, run with pio test -e native
+*/
+#include <unity.h>
+#include <stdio.h>
+#include "Arduino.h"
+#include "Wire.h"
+#include "INA219.h"
+#include "INA219Model.h"
+
+INA219Model model;
+INA219 sensor;
+
+uint16_t readRegister(uint8_t reg)
+{
+  Wire.beginTransmission(INA219_MODEL_ADDRESS);
+  Wire.write(reg);
+  Wire.endTransmission();
+  Wire.requestFrom(INA219_MODEL_ADDRESS, 2);
+  return (Wire.read() << 8) | Wire.read();
+}
+
+void writeRegister(uint8_t reg, uint16_t value)
+{
+  Wire.beginTransmission(INA219_MODEL_ADDRESS);
+  Wire.write(reg);
+  Wire.write(value >> 8);
+  Wire.write(value & 0xFF);
+  Wire.endTransmission();
+}
+
+void setUp(void)
+{
+  native_reset();
+  model.set(5000, 500);
+  Wire.attach(INA219_MODEL_ADDRESS, &model);
+  sensor.begin();
+}
+
+void tearDown(void) {}
+
+void test_begin_config(void)
+{
+  TEST_ASSERT_EQUAL(0x1000, readRegister(INA219_REG_CALIBRATION));
+  TEST_ASSERT_EQUAL(INA219_CONFIG_BVOLTAGERANGE_32V | INA219_CONFIG_GAIN_8_320MV | INA219_CONFIG_BADCRES_12BIT |
+                    INA219_CONFIG_SADCRES_12BIT_1S_532US | INA219_CONFIG_MODE_SANDBVOLT_CONTINUOUS,
+                    readRegister(INA219_REG_CONFIG));
+}
+
+void test_conversion_timing(void)
+{
+  // 12 bit shunt + 12 bit bus, 1064us per conversion after the config write
+  native_advance(1063);
+  TEST_ASSERT_FALSE(readRegister(INA219_REG_BUSVOLTAGE) & 0x2);
+  TEST_ASSERT_EQUAL(0, sensor.getCurrent_mA());
+  native_advance(1);
+  TEST_ASSERT_TRUE(readRegister(INA219_REG_BUSVOLTAGE) & 0x2);
+  TEST_ASSERT_EQUAL(500, sensor.getCurrent_mA());
+  TEST_ASSERT_EQUAL(5000, sensor.getBusVoltage_V());
+  TEST_ASSERT_EQUAL(5000, (int16_t)readRegister(INA219_REG_SHUNTVOLTAGE));
+  TEST_ASSERT_EQUAL(500 * 5 / 2, readRegister(INA219_REG_POWER)); //2mW LSB
+  // Reading power clears CNVR until the next conversion
+  TEST_ASSERT_FALSE(readRegister(INA219_REG_BUSVOLTAGE) & 0x2);
+  native_advance(1064);
+  TEST_ASSERT_TRUE(readRegister(INA219_REG_BUSVOLTAGE) & 0x2);
+}
+
+void test_overflow(void)
+{
+  // 4A is 400mV across 0.1 ohm, past the 320mV range
+  model.set(5000, 4000);
+  native_advance(2000);
+  TEST_ASSERT_EQUAL(32000, (int16_t)readRegister(INA219_REG_SHUNTVOLTAGE));
+  TEST_ASSERT_TRUE(readRegister(INA219_REG_BUSVOLTAGE) & 0x1);
+  model.set(5000, 500);
+  native_advance(1064);
+  TEST_ASSERT_FALSE(readRegister(INA219_REG_BUSVOLTAGE) & 0x1);
+}
+
+void test_triggered_and_resolution(void)
+{
+  // Single 9 bit shunt conversion, 84us, value rounded down to 8 LSB steps
+  model.set(5000, 123.4);
+  uint32_t before = model.conversions;
+  writeRegister(INA219_REG_CONFIG, INA219_CONFIG_GAIN_8_320MV | INA219_CONFIG_SADCRES_9BIT_1S_84US | INA219_CONFIG_MODE_SVOLT_TRIGGERED);
+  native_advance(84);
+  TEST_ASSERT_EQUAL(1232, (int16_t)readRegister(INA219_REG_SHUNTVOLTAGE));
+  native_advance(10000);
+  readRegister(INA219_REG_SHUNTVOLTAGE);
+  TEST_ASSERT_EQUAL(before + 1, model.conversions);
+}
+
+void test_fast_current(void)
+{
+  // 9 bit shunt only conversions every 84us, reads without a pointer write
+  native_advance(2000);
+  sensor.setSpeed(INA219_SPEED_CURRENT);
+  TEST_ASSERT_EQUAL(INA219_CONFIG_BVOLTAGERANGE_32V | INA219_CONFIG_GAIN_8_320MV | INA219_CONFIG_SADCRES_9BIT_1S_84US |
+                    INA219_CONFIG_MODE_SVOLT_CONTINUOUS, model.regs[INA219_REG_CONFIG]);
+  model.set(5000, 123.4);
+  uint32_t transactions = Wire.transactions;
+  native_advance(84);
+  TEST_ASSERT_EQUAL(123, sensor.getCurrentFast_mA());
+  TEST_ASSERT_EQUAL(1, Wire.transactions - transactions);
+  // Negative currents and large ones, value + half is 32 bit so it no longer wraps on the AVR near full scale
+  model.set(5000, -123.4);
+  native_advance(84);
+  TEST_ASSERT_EQUAL(-123, sensor.getCurrentFast_mA());
+  model.set(5000, 3000.06);
+  native_advance(84);
+  TEST_ASSERT_EQUAL(3000, sensor.getCurrentFast_mA());
+  uint32_t conversions = model.conversions;
+  native_advance(840);
+  sensor.getCurrentFast_mA();
+  TEST_ASSERT_EQUAL(conversions + 10, model.conversions);
+  // 9 bit shunt and bus, 168us
+  sensor.setSpeed(INA219_SPEED_FAST);
+  TEST_ASSERT_EQUAL(INA219_CONFIG_BVOLTAGERANGE_32V | INA219_CONFIG_GAIN_8_320MV |
+                    INA219_CONFIG_SADCRES_9BIT_1S_84US | INA219_CONFIG_MODE_SANDBVOLT_CONTINUOUS,
+                    readRegister(INA219_REG_CONFIG));
+  native_advance(167);
+  TEST_ASSERT_FALSE(readRegister(INA219_REG_BUSVOLTAGE) & 0x2);
+  native_advance(1);
+  TEST_ASSERT_TRUE(readRegister(INA219_REG_BUSVOLTAGE) & 0x2);
+  sensor.setSpeed(INA219_SPEED_NORMAL);
+  TEST_ASSERT_EQUAL(INA219_CONFIG_BVOLTAGERANGE_32V | INA219_CONFIG_GAIN_8_320MV | INA219_CONFIG_BADCRES_12BIT |
+                    INA219_CONFIG_SADCRES_12BIT_1S_532US | INA219_CONFIG_MODE_SANDBVOLT_CONTINUOUS,
+                    readRegister(INA219_REG_CONFIG));
+}
+
+void test_waveforms(void)
+{
+  model.set(5000, 100);
+  model.step(1000, 5000, 200);
+  model.ramp(2000, 4000, 400);
+  model.burst(5000, 1000, 100, 1000, 2);
+  TEST_ASSERT_EQUAL_FLOAT(100, model.current(999));
+  TEST_ASSERT_EQUAL_FLOAT(200, model.current(1000));
+  TEST_ASSERT_EQUAL_FLOAT(300, model.current(1500));
+  TEST_ASSERT_EQUAL_FLOAT(4500, model.bus(1500));
+  TEST_ASSERT_EQUAL_FLOAT(400, model.current(3000));
+  TEST_ASSERT_EQUAL_FLOAT(1400, model.current(6050));
+  TEST_ASSERT_EQUAL_FLOAT(400, model.current(6150));
+  TEST_ASSERT_EQUAL_FLOAT(400, model.current(7050)); //Only 2 pulses
+
+  const char *path = "ina219_trace.csv";
+  FILE *f = fopen(path, "w");
+  fputs("# t_us,mA,mV\n0,10,5100\n500,20\n1000,30,4900\n", f);
+  fclose(f);
+  model.set(0, 0);
+  TEST_ASSERT_TRUE(model.loadCSV(path));
+  remove(path);
+  TEST_ASSERT_EQUAL_FLOAT(10, model.current(499));
+  TEST_ASSERT_EQUAL_FLOAT(20, model.current(500));
+  TEST_ASSERT_EQUAL_FLOAT(5100, model.bus(999));
+  TEST_ASSERT_EQUAL_FLOAT(4900, model.bus(1000));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_config);
+  RUN_TEST(test_conversion_timing);
+  RUN_TEST(test_overflow);
+  RUN_TEST(test_triggered_and_resolution);
+  RUN_TEST(test_fast_current);
+  RUN_TEST(test_waveforms);
+  return UNITY_END();
+}
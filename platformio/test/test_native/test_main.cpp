@@ -0,0 +1,286 @@
+/*
+  Host scenarios for the firmware, run with pio test -e native
+
+  Each test restarts the virtual clock and calls setup() again, firmware
+  globals carry over between tests so checks only look at fresh output.
+*/
+#include <unity.h>
+#include <string>
+#include "Arduino.h"
+#include "Wire.h"
+#include "INA219Model.h"
+#include "TimerOne.h"
+
+extern uint8_t current_screen;
+extern volatile uint16_t capture_Mem[];
+
+INA219Model ina;
+
+// Runs the firmware for ms of virtual time, one loop per step_us
+void run(uint32_t ms, uint32_t step_us = 1000)
+{
+  for (uint64_t end = native_micros + ms * 1000ULL; native_micros < end; ) {
+    loop();
+    native_advance(step_us);
+  }
+}
+
+// Last complete line of serial output starting with prefix
+std::string lastLine(const char *prefix)
+{
+  std::string &out = Serial.output;
+  size_t end = out.rfind("\r\n");
+  while (end != std::string::npos && end > 0) {
+    size_t start = out.rfind("\r\n", end - 1);
+    start = (start == std::string::npos) ? 0 : start + 2;
+    if (out.compare(start, strlen(prefix), prefix) == 0) return out.substr(start, end - start);
+    if (start == 0) break;
+    end = start - 2;
+  }
+  return "";
+}
+
+// Number after "key": in line, -1 if missing
+double field(const std::string &line, const char *key)
+{
+  std::string k = std::string("\"") + key + "\":";
+  size_t p = line.find(k);
+  return p == std::string::npos ? -1 : atof(line.c_str() + p + k.size());
+}
+
+void setUp(void)
+{
+  native_reset();
+  ina.set(5000, 500);
+  Wire.attach(INA219_MODEL_ADDRESS, &ina);
+  setup();
+}
+
+void tearDown(void) {}
+
+void test_report_constant_load(void)
+{
+  run(3000);
+  std::string line = lastLine("{ \"a\"");
+  TEST_ASSERT_TRUE(line.find("\"a\":{ \"max\":500, \"min\":500, \"avg\":500.00}") != std::string::npos);
+  TEST_ASSERT_TRUE(line.find("\"v\":{ \"max\":5.00, \"min\":5.00, \"avg\":5.00}") != std::string::npos);
+}
+
+void test_commands(void)
+{
+  Serial.inject("V?;R:50;R?;Q:1;S:0\n");
+  run(10);
+  std::string &out = Serial.output;
+  TEST_ASSERT_TRUE(out.find("{\"V\":") != std::string::npos);
+  // JSON reports stay at 100ms or slower
+  TEST_ASSERT_TRUE(out.find("{\"R\":100}\r\n{\"R\":100}\r\n") != std::string::npos);
+  TEST_ASSERT_TRUE(out.find("{\"err\":\"cmd\",\"c\":\"Q\"}") != std::string::npos);
+  TEST_ASSERT_TRUE(out.find("{\"err\":\"val\",\"c\":\"S\"}") != std::string::npos);
+  // S and the "s" of C:3 use the screen number as sent, F takes all values or none
+  Serial.inject("S:2;S?;C:3;F:127,1000,0,0,256;F:-1;F?;S:1\n");
+  run(10);
+  TEST_ASSERT_TRUE(out.find("{\"S\":2}\r\n{\"S\":2}\r\n{\"RC\":{\"s\":2, ") != std::string::npos);
+  TEST_ASSERT_TRUE(out.find("{\"err\":\"val\",\"c\":\"F\"}\r\n{\"err\":\"val\",\"c\":\"F\"}\r\n{\"F\":{\"f\":127,\"r\":[100,0,0,1]}}") != std::string::npos);
+  Serial.inject("R:1000\n");
+  run(10);
+}
+
+void test_sync(void)
+{
+  // A drift past SYNC_DRIFT_MAX would overflow hostMicros(), it is refused and the last sync kept
+  Serial.inject("Y:5000,0,0,50;Y:5000,0,0,2000000;Y:5000,0,0,-2000000;Y?\n");
+  run(10);
+  TEST_ASSERT_TRUE(Serial.output.find("{\"err\":\"val\",\"c\":\"Y\"}\r\n{\"err\":\"val\",\"c\":\"Y\"}\r\n") != std::string::npos);
+  TEST_ASSERT_EQUAL(50, field(lastLine("{\"Y\""), "p"));
+  Serial.inject("Y:0,0,0\n");
+  run(10);
+}
+
+void test_memory(void)
+{
+  // Values are 0 on the host, only the replies are checked
+  Serial.inject("M:;F:255\n");
+  run(1500);
+  TEST_ASSERT_TRUE(Serial.output.find("{\"M\":{\"f\":0,\"l\":0,\"s\":0}}") != std::string::npos);
+  TEST_ASSERT_TRUE(lastLine("{ \"a\"").find("\"ram\":0") != std::string::npos);
+  // Every field, longer than the TX buffer leaves periodic messages behind the reserve
+  Serial.inject("F:1023\n");
+  run(1500);
+  TEST_ASSERT_TRUE(lastLine("{ \"a\"").find("\"ts\":") != std::string::npos);
+  Serial.inject("F:127\n");
+  run(10);
+}
+
+void test_tasks(void)
+{
+  // One line per task, passes 1ms apart keep every deadline
+  Serial.inject("L:0\n");
+  run(500);
+  Serial.inject("L?\n");
+  run(50);
+  std::string line = lastLine("{\"L\":\"drain\"");
+  TEST_ASSERT_TRUE(field(line, "n") > 400);
+  TEST_ASSERT_EQUAL(0, (int)field(line, "miss"));
+  TEST_ASSERT_TRUE(field(lastLine("{\"L\":\"render\""), "n") > 0);
+  // Passes 20ms apart are late for the 5ms deadline of events
+  Serial.inject("L:0\n");
+  run(500, 20000);
+  Serial.inject("L:1\n");
+  run(50);
+  TEST_ASSERT_TRUE(field(lastLine("{\"L\":\"events\""), "miss") > 10);
+}
+
+void test_idle(void)
+{
+  // Nothing sleeps on the host, checks the reply and that the V screen measures Vcc, D+ and D-
+  Serial.inject("I:0;S:6\n");
+  run(500);
+  TEST_ASSERT_TRUE(Serial.output.find("{\"I\":{\"s\":0,") != std::string::npos);
+  Serial.inject("I?\n");
+  run(10);
+  std::string line = lastLine("{\"I\"");
+  TEST_ASSERT_TRUE_MESSAGE(line.find("\"pp\":[0,0,0]") != std::string::npos, line.c_str());
+  // Nothing measured when neither the V screen nor the report needs D+/D-
+  Serial.inject("I:1;S:1;F:95\n");
+  run(500);
+  Serial.inject("I?\n");
+  run(10);
+  line = lastLine("{\"I\"");
+  TEST_ASSERT_TRUE_MESSAGE(line.find("{\"I\":{\"s\":1,\"i\":0,\"pp\":[-1,-1,-1]}}") != std::string::npos, line.c_str());
+  Serial.inject("F:127\n");
+  run(10);
+}
+
+void test_boot(void)
+{
+  // 20ms of 500mA from reset, as an inrush, then 100mA
+  ina.step(native_micros + 20000, 5000, 100);
+  run(1100);
+  // Sampled from the first ms, behind the splash
+  Serial.inject("K?\n");
+  run(10);
+  TEST_ASSERT_TRUE(Serial.output.find("{\"K\":{\"s\":0,\"n\":256}}") != std::string::npos);
+  TEST_ASSERT_EQUAL(500, capture_Mem[0]);
+  TEST_ASSERT_EQUAL(100, capture_Mem[255]);
+  // and the first report covers it
+  std::string line = lastLine("{ \"a\"");
+  TEST_ASSERT_EQUAL(500, (int)field(line, "max"));
+  TEST_ASSERT_TRUE(field(line, "time") < 1100);
+}
+
+void test_inrush(void)
+{
+  // Bus off, armed once it has been seen low, the bus is polled every 200us
+  ina.set(0, 0);
+  uint8_t screen = current_screen;
+  Serial.inject("N:1\n");
+  run(10);
+  TEST_ASSERT_TRUE(Serial.output.find("{\"N\":{\"s\":2,\"t\":4000,\"ms\":20,\"n\":0}}") != std::string::npos);
+  TEST_ASSERT_EQUAL(200, Timer1.period);
+  // Plug-in: 5V with 1A for 2ms on top of 100mA
+  uint64_t plug = native_micros + 5000;
+  ina.step(plug, 5000, 100);
+  ina.burst(plug, 1000000, 2000, 900, 1);
+  run(100);
+  std::string line = lastLine("{\"inrush\"");
+  TEST_ASSERT_TRUE_MESSAGE(line.size() > 0, Serial.output.c_str());
+  TEST_ASSERT_EQUAL(1000, (int)field(line, "pk"));
+  TEST_ASSERT_EQUAL(100, (int)field(line, "a"));
+  TEST_ASSERT_EQUAL(200, (int)field(line, "n"));
+  TEST_ASSERT_EQUAL(0, (int)field(line, "skip"));
+  // Triggered within a poll and a conversion of the rise, most of the 2ms is in the window
+  double settle = field(line, "st");
+  TEST_ASSERT_TRUE_MESSAGE(settle >= 1600 && settle <= 2000, line.c_str());
+  // 1A until settled, 100mA for the rest of the 20ms
+  TEST_ASSERT_FLOAT_WITHIN(150, 1000 * settle / 1000 + 100 * (20000 - settle) / 1000, field(line, "uc"));
+  // Results are on the inrush screen, the display stays where it was
+  TEST_ASSERT_EQUAL(screen, current_screen);
+  // Armed again, waiting for the bus to drop
+  TEST_ASSERT_EQUAL(200, Timer1.period);
+  TEST_ASSERT_TRUE(ina.staleReads * 10 < ina.reads);
+  Serial.inject("N?\n");
+  run(10);
+  TEST_ASSERT_TRUE(lastLine("{\"N\"").find("{\"N\":{\"s\":3,\"t\":4000,\"ms\":20,\"n\":1}}") != std::string::npos);
+  // Disarmed, full conversions every ms
+  Serial.inject("N:0;S:1\n");
+  run(10);
+  TEST_ASSERT_EQUAL(1000, Timer1.period);
+}
+
+// Holds the button (D10) for ms, loop() runs unless stalled
+void press(uint32_t ms, bool stalled = false)
+{
+  native_pins[10] = HIGH;
+  if (stalled) native_advance(ms * 1000); else run(ms);
+  native_pins[10] = LOW;
+}
+
+void test_button(void)
+{
+  Serial.inject("S:1\n");
+  run(300);
+  press(60);
+  run(400);
+  TEST_ASSERT_EQUAL(1, current_screen);
+  // Press and release while the loop is held up, as by a long frame, the edge times still make a click
+  press(60, true);
+  native_advance(100000);
+  run(400);
+  TEST_ASSERT_EQUAL(2, current_screen);
+  // Bounces under 20ms are not clicks
+  press(5, true);
+  native_advance(5000);
+  press(5, true);
+  run(400);
+  TEST_ASSERT_EQUAL(2, current_screen);
+  // Long press resets and shows the message screen
+  press(2100);
+  TEST_ASSERT_EQUAL(7, current_screen);
+  run(2000);
+  TEST_ASSERT_EQUAL(2, current_screen);
+  Serial.inject("S:1\n");
+  run(10);
+}
+
+void test_burst_in_report(void)
+{
+  // 5ms 1A bursts every 100ms on top of the 500mA load
+  ina.burst(native_micros, 100000, 5000, 1000);
+  run(3000);
+  std::string line = lastLine("{ \"a\"");
+  TEST_ASSERT_EQUAL(1500, (int)field(line, "max"));
+  TEST_ASSERT_FLOAT_WITHIN(10, 550, field(line, "avg"));
+  // Sampling must not outrun the conversions by much
+  TEST_ASSERT_TRUE(ina.staleReads * 10 < ina.reads);
+}
+
+void test_energy_one_hour(void)
+{
+  // Display off, rendering is most of the host time
+  Serial.inject("Z:;D:0\n");
+  run(3600000UL, 10000);
+  // 500mA for the time in the report, reports are 1s apart so allow one period
+  std::string line = lastLine("{ \"a\"");
+  double hours = field(line, "time") / 3600000.0;
+  TEST_ASSERT_FLOAT_WITHIN(0.01 + 500 * 1.0 / 3600, 500 * hours, field(line, "mah"));
+  TEST_ASSERT_FLOAT_WITHIN(0.01 + 2500 * 1.0 / 3600, 2500 * hours, field(line, "mwh"));
+  Serial.inject("D:1\n");
+  run(10);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_report_constant_load);
+  RUN_TEST(test_commands);
+  RUN_TEST(test_sync);
+  RUN_TEST(test_memory);
+  RUN_TEST(test_tasks);
+  RUN_TEST(test_idle);
+  RUN_TEST(test_boot);
+  RUN_TEST(test_inrush);
+  RUN_TEST(test_button);
+  RUN_TEST(test_burst_in_report);
+  RUN_TEST(test_energy_one_hour);
+  return UNITY_END();
+}
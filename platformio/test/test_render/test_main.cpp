@@ -0,0 +1,207 @@
+/*
+  Render benchmark of every screen, run with pio test -e native
+
+  Each screen is drawn RENDER_FRAMES times into U8glib's page buffer with
+  the com layer left as the null procedure, so only the render path is
+  measured. The device procedure is wrapped to count the calls U8glib
+  makes into it on each page: single pixels (drawPixel, lines) and 8 pixel
+  rows (glyphs, one per glyph row).
+
+  Counts are compared with test/test_render/baseline.txt and must match,
+  a change in the render path shows up as a failure until the baseline is
+  updated (delete it to write it again). Host time per frame is stored
+  with it for reference only, it does not say much about the 32u4.
+*/
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "Arduino.h"
+#include "Wire.h"
+#include "INA219Model.h"
+#include <U8glib.h>
+
+#define RENDER_FRAMES 2000
+#define RENDER_PAGES 8
+#define BASELINE "test/test_render/baseline.txt"
+
+extern U8GLIB_SSD1306_128X64 display;
+extern volatile uint16_t current_mA;
+extern float loadvoltage_OUT;
+void drawBottomLine();
+void drawScope(uint32_t now);
+void drawEnergy(uint32_t now);
+void drawPeakMins(uint32_t now);
+void drawInrush(uint32_t now);
+void drawBig(float val, char* unit, uint8_t decimals);
+void drawMsg();
+void setMsg(char* msg, uint16_t time);
+
+INA219Model ina;
+
+struct Counts {
+  uint32_t pixel;
+  uint32_t pixel8;
+};
+
+struct Result {
+  const char *name;
+  Counts total;
+  Counts page[RENDER_PAGES];
+  double us;
+};
+
+static u8g_dev_fnptr renderDev;
+static uint8_t renderPage;
+static Counts renderCounts[RENDER_PAGES];
+
+uint8_t countingDev(u8g_t *u8g, u8g_dev_t *dev, uint8_t msg, void *arg)
+{
+  switch (msg) {
+    case U8G_DEV_MSG_PAGE_FIRST: renderPage = 0; break;
+    case U8G_DEV_MSG_SET_PIXEL: renderCounts[renderPage].pixel++; break;
+    case U8G_DEV_MSG_SET_8PIXEL: renderCounts[renderPage].pixel8++; break;
+  }
+  uint8_t r = renderDev(u8g, dev, msg, arg);
+  if (msg == U8G_DEV_MSG_PAGE_NEXT && renderPage < RENDER_PAGES - 1) renderPage++;
+  return r;
+}
+
+// Same screens as the switch in loop()
+void screenScope() { drawScope(millis()); }
+void screenEnergy() { drawEnergy(millis()); }
+void screenPeak() { drawPeakMins(millis()); }
+void screenInrush() { drawInrush(millis()); }
+void screenWatts() { drawBig((current_mA*loadvoltage_OUT)/1000, "W", 2); }
+void screenAmps() { drawBig(current_mA, "mA", 0); }
+void screenVolts() { drawBig(loadvoltage_OUT, "V", 2); }
+void screenMsg() { drawMsg(); }
+
+struct Screen {
+  const char *name;
+  void (*draw)();
+};
+
+static const Screen screens[] = {
+  {"scope", screenScope},
+  {"energy", screenEnergy},
+  {"peak", screenPeak},
+  {"watts", screenWatts},
+  {"amps", screenAmps},
+  {"volts", screenVolts},
+  {"inrush", screenInrush},
+  {"msg", screenMsg},
+};
+#define SCREENS (sizeof(screens) / sizeof(screens[0]))
+
+static Result results[SCREENS];
+
+Result render(const Screen &s)
+{
+  Result r;
+  memset(&r, 0, sizeof(r));
+  r.name = s.name;
+  u8g_dev_t *dev = display.getU8g()->dev;
+  renderDev = dev->dev_fn;
+  dev->dev_fn = countingDev;
+  memset(renderCounts, 0, sizeof(renderCounts));
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint16_t i = 0; i < RENDER_FRAMES; i++) {
+    display.firstPage();
+    do {
+      s.draw();
+      drawBottomLine();
+    } while (display.nextPage());
+  }
+  std::chrono::duration<double, std::micro> took = std::chrono::steady_clock::now() - start;
+  dev->dev_fn = renderDev;
+  r.us = took.count() / RENDER_FRAMES;
+  for (uint8_t p = 0; p < RENDER_PAGES; p++) {
+    r.page[p].pixel = renderCounts[p].pixel / RENDER_FRAMES;
+    r.page[p].pixel8 = renderCounts[p].pixel8 / RENDER_FRAMES;
+    r.total.pixel += r.page[p].pixel;
+    r.total.pixel8 += r.page[p].pixel8;
+  }
+  return r;
+}
+
+// Line per screen: name us pixel pixel8 then pixel/pixel8 for each page
+void writeBaseline()
+{
+  FILE *f = fopen(BASELINE, "w");
+  TEST_ASSERT_TRUE(f != NULL);
+  if (!f) return;
+  fprintf(f, "# screen us/frame pixel 8pixel, then pixel/8pixel per page\n");
+  for (uint8_t i = 0; i < SCREENS; i++) {
+    Result &r = results[i];
+    fprintf(f, "%s %.1f %u %u", r.name, r.us, r.total.pixel, r.total.pixel8);
+    for (uint8_t p = 0; p < RENDER_PAGES; p++) fprintf(f, " %u/%u", r.page[p].pixel, r.page[p].pixel8);
+    fprintf(f, "\n");
+  }
+  fclose(f);
+}
+
+void setUp(void)
+{
+  native_reset();
+  ina.set(5000, 500);
+  Wire.attach(INA219_MODEL_ADDRESS, &ina);
+}
+
+void tearDown(void) {}
+
+void test_render_screens(void)
+{
+  // Representative data: a varying load fills the graph, peaks and energy
+  setup();
+  ina.burst(native_micros, 250000, 40000, 1200);
+  ina.ramp(native_micros + 4000000, 4750, 900);
+  for (uint32_t i = 0; i < 5000; i++) {
+    loop();
+    native_advance(1000);
+  }
+  setMsg("Reset", 100);
+  for (uint8_t i = 0; i < SCREENS; i++) results[i] = render(screens[i]);
+
+  char line[160];
+  for (uint8_t i = 0; i < SCREENS; i++) {
+    Result &r = results[i];
+    int n = snprintf(line, sizeof(line), "%-7s %6.1f us/frame %5u pixel %4u 8pixel |", r.name, r.us, r.total.pixel, r.total.pixel8);
+    for (uint8_t p = 0; p < RENDER_PAGES; p++) n += snprintf(line + n, sizeof(line) - n, " %u/%u", r.page[p].pixel, r.page[p].pixel8);
+    TEST_MESSAGE(line);
+  }
+
+  FILE *f = fopen(BASELINE, "r");
+  if (!f) {
+    writeBaseline();
+    TEST_IGNORE_MESSAGE("baseline written");
+  }
+  char name[16], pages[RENDER_PAGES][16];
+  float us;
+  unsigned pixel, pixel8;
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%15s %f %u %u %15s %15s %15s %15s %15s %15s %15s %15s", name, &us, &pixel, &pixel8,
+        pages[0], pages[1], pages[2], pages[3], pages[4], pages[5], pages[6], pages[7]) != 12) continue;
+    for (uint8_t i = 0; i < SCREENS; i++) {
+      Result &r = results[i];
+      if (strcmp(name, r.name)) continue;
+      snprintf(line, sizeof(line), "%s: %u/%u calls, baseline %u/%u, %.1f us/frame, baseline %.1f",
+        name, r.total.pixel, r.total.pixel8, pixel, pixel8, r.us, us);
+      TEST_ASSERT_TRUE_MESSAGE(r.total.pixel == pixel && r.total.pixel8 == pixel8, line);
+      for (uint8_t p = 0; p < RENDER_PAGES; p++) {
+        char got[16];
+        snprintf(got, sizeof(got), "%u/%u", r.page[p].pixel, r.page[p].pixel8);
+        TEST_ASSERT_TRUE_MESSAGE(!strcmp(got, pages[p]), line);
+      }
+    }
+  }
+  fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_render_screens);
+  return UNITY_END();
+}